@@ -0,0 +1,20 @@
+// buffer and page cache statistics, and the block
+// allocator's free counts, reported by bcstat().
+#define NBCGROUP 64           // groups bcstat() reports, at most
+
+struct bcstat {
+  uint64 hits;       // bread()s that found the block cached
+  uint64 misses;     // bread()s that read it from disk
+  uint64 evictions;  // cached blocks dropped to make room for others
+  uint64 grows;      // pages of buffers added
+  uint64 shrinks;    // pages of buffers given back to kalloc()
+  uint64 nbuf;       // buffers now
+  uint64 phits;      // file pages found in the page cache
+  uint64 pmisses;    // file pages read in
+  uint64 npage;      // page cache pages now
+  uint64 ndirty;     // of which waiting to be written back
+  uint64 pwrites;    // file blocks written back
+  uint64 ngroup;     // block groups on the disk
+  uint64 groupsize;  // blocks in each group
+  uint64 gfree[NBCGROUP]; // free blocks in each group now
+};
@@ -5,6 +5,12 @@
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
 //
+// Buffers are added a page at a time while memory is plentiful,
+// and kalloc() takes pages back with bshrink() when it runs out,
+// so the cache holds as much of the disk as memory allows.
+// The buffers are BSIZE bytes, and are made again when
+// fsinit() learns the file system's block size.
+//
 // Interface:
 // * To get a buffer for a particular disk block, call bread.
 // * After changing buffer data, call bwrite to write it to disk.
@@ -22,50 +28,140 @@
 #include "defs.h"
 #include "fs.h"
 #include "buf.h"
+#include "proc.h"
+#include "ktrace.h"
+#include "bcstat.h"
+
+#define NBHASH 1021
+#define BPERPAGE (PGSIZE / BSIZE)              // buffers sharing a data page
+#define MAXBPERPAGE (PGSIZE / MINBSIZE)
+#define HPERPAGE (PGSIZE / sizeof(struct buf)) // headers in a page
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *hash[NBHASH];
+  struct buf *spare;   // headers without data, through hnext
+  int nspare;
+  uint64 reserve;      // add buffers only while more pages are free
+  struct bcstat st;
 
-  // Linked list of all buffers, through prev/next.
+  // Linked list of all buffers with data, through prev/next.
   // Sorted by how recently the buffer was used.
   // head.next is most recent, head.prev is least.
   struct buf head;
 } bcache;
 
+// the block size. fsinit() sets it with bsetsize() once it
+// has read the super block, which is MINBSIZE bytes in.
+uint fsbsize = MINBSIZE;
+
+static int bgrow(void);
+
 void
 binit(void)
 {
-  struct buf *b;
-
   initlock(&bcache.lock, "bcache");
-
-  // Create linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  // leave an eighth of memory to everything else.
+  bcache.reserve = kfreepages() / 8;
+  while(bcache.st.nbuf < NBUF)
+    if(bgrow() == 0)
+      panic("binit");
+}
+
+static struct buf**
+bhash(uint dev, uint blockno)
+{
+  return &bcache.hash[(dev * 31 + blockno) % NBHASH];
+}
+
+// Remove b from its hash chain, if it's on one.
+static void
+unhash(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp = bhash(b->dev, b->blockno); *pp; pp = &(*pp)->hnext){
+    if(*pp == b){
+      *pp = b->hnext;
+      return;
+    }
   }
 }
 
+// Add a page of buffers, least recently used, so that bget()
+// uses them before dropping any cached block. Returns 0 if
+// out of memory.
+static int
+bgrow(void)
+{
+  struct buf *b, *first, *last;
+  char *data, *page;
+  int i;
+
+  if((data = kalloc()) == 0)
+    return 0;
+  acquire(&bcache.lock);
+  if(bcache.nspare < BPERPAGE){
+    release(&bcache.lock);
+    if((page = kalloc()) == 0){
+      kfree(data);
+      return 0;
+    }
+    memset(page, 0, PGSIZE);
+    acquire(&bcache.lock);
+    b = (struct buf*)page;
+    for(i = 0; i < HPERPAGE; i++, b++){
+      initsleeplock(&b->lock, "buffer");
+      b->hnext = bcache.spare;
+      bcache.spare = b;
+      bcache.nspare++;
+    }
+  }
+
+  first = last = 0;
+  for(i = 0; i < BPERPAGE; i++){
+    b = bcache.spare;
+    bcache.spare = b->hnext;
+    bcache.nspare--;
+    b->data = (uchar*)data + i*BSIZE;
+    b->valid = 0;
+    b->refcnt = 0;
+    b->prev = bcache.head.prev;
+    b->next = &bcache.head;
+    bcache.head.prev->next = b;
+    bcache.head.prev = b;
+    if(first == 0)
+      first = b;
+    else
+      last->sib = b;
+    last = b;
+  }
+  last->sib = first;
+  bcache.st.grows++;
+  bcache.st.nbuf += BPERPAGE;
+  release(&bcache.lock);
+  return 1;
+}
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
 // In either case, return locked buffer.
 static struct buf*
 bget(uint dev, uint blockno)
 {
-  struct buf *b;
+  struct buf *b, **pp;
+  int grown = 0;
 
   acquire(&bcache.lock);
 
+again:
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
+  for(b = *bhash(dev, blockno); b; b = b->hnext){
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
+      bcache.st.hits++;
       release(&bcache.lock);
       acquiresleep(&b->lock);
       return b;
@@ -73,19 +169,219 @@ bget(uint dev, uint blockno)
   }
 
   // Not cached.
-  // Recycle the least recently used (LRU) unused buffer.
+  // Recycle the least recently used (LRU) unused buffer;
+  // but rather than drop a cached block, add buffers if
+  // there's memory to spare.
+  for(b = bcache.head.prev; b != &bcache.head; b = b->prev)
+    if(b->refcnt == 0)
+      break;
+  if((b == &bcache.head || b->valid) && !grown &&
+     kfreepages() > bcache.reserve){
+    release(&bcache.lock);
+    bgrow();
+    acquire(&bcache.lock);
+    grown = 1;
+    goto again;
+  }
+  if(b == &bcache.head)
+    panic("bget: no buffers");
+
+  bcache.st.misses++;
+  if(b->valid)
+    bcache.st.evictions++;
+  unhash(b);
+  b->dev = dev;
+  b->blockno = blockno;
+  b->valid = 0;
+  b->refcnt = 1;
+  pp = bhash(dev, blockno);
+  b->hnext = *pp;
+  *pp = b;
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Free the page holding header h, if all its headers are
+// spare. Caller holds bcache.lock.
+static void
+freehdrs(struct buf *h)
+{
+  struct buf *page, **pp;
+  int n;
+
+  page = (struct buf*)PGROUNDDOWN((uint64)h);
+  n = 0;
+  for(h = bcache.spare; h; h = h->hnext)
+    if(PGROUNDDOWN((uint64)h) == (uint64)page)
+      n++;
+  if(n < HPERPAGE)
+    return;
+  for(pp = &bcache.spare; *pp; ){
+    if(PGROUNDDOWN((uint64)*pp) == (uint64)page)
+      *pp = (*pp)->hnext;
+    else
+      pp = &(*pp)->hnext;
+  }
+  bcache.nspare -= HPERPAGE;
+  kfree(page);
+}
+
+// Give the page of buffers holding b, which are all unused,
+// back to kalloc(). Caller holds bcache.lock.
+static void
+bfreepage(struct buf *b)
+{
+  struct buf *s, *hdr[MAXBPERPAGE];
+  int i;
+
+  kfree((void*)PGROUNDDOWN((uint64)b->data));
+  s = b;
+  i = 0;
+  do {
+    hdr[i++] = s;
+    s->next->prev = s->prev;
+    s->prev->next = s->next;
+    unhash(s);
+    s->data = 0;
+    s->valid = 0;
+    s->hnext = bcache.spare;
+    bcache.spare = s;
+    bcache.nspare++;
+    s = s->sib;
+  } while(s != b);
+  // freehdrs() may free the page holding later headers,
+  // so don't follow sib through them.
+  for(i = 0; i < BPERPAGE; i++)
+    freehdrs(hdr[i]);
+  bcache.st.shrinks++;
+  bcache.st.nbuf -= BPERPAGE;
+}
+
+// Give the least recently used page of buffers that are all
+// unused back to kalloc(), which is out of memory. Returns 1
+// if there was one. an unused buffer's block is on disk, or
+// the log would hold a reference to it.
+int
+bshrink(void)
+{
+  struct buf *b, *s;
+
+  acquire(&bcache.lock);
+  if(bcache.st.nbuf < NBUF + BPERPAGE){
+    release(&bcache.lock);
+    return 0;
+  }
   for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->valid = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
+    if(b->refcnt)
+      continue;
+    for(s = b->sib; s != b && s->refcnt == 0; s = s->sib)
+      ;
+    if(s == b)
+      break;
+  }
+  if(b == &bcache.head){
+    release(&bcache.lock);
+    return 0;
+  }
+  bfreepage(b);
+  release(&bcache.lock);
+  return 1;
+}
+
+// Drop every buffer and make them again with size-byte
+// blocks. for fsinit(), before anything else uses the disk.
+void
+bsetsize(uint size)
+{
+  struct buf *b;
+
+  acquire(&bcache.lock);
+  while((b = bcache.head.next) != &bcache.head){
+    if(b->refcnt)
+      panic("bsetsize");
+    bfreepage(b);
+  }
+  fsbsize = size;
+  release(&bcache.lock);
+  while(bcache.st.nbuf < NBUF)
+    if(bgrow() == 0)
+      panic("bsetsize");
+}
+
+void
+bstat(struct bcstat *st)
+{
+  acquire(&bcache.lock);
+  *st = bcache.st;
+  release(&bcache.lock);
+}
+
+// Copy block blockno into dst, without caching it: from its
+// buffer if it has one, which may be newer than the disk,
+// else straight from the disk. for the page cache, which
+// keeps file data itself.
+void
+bload(uint dev, uint blockno, uchar *dst)
+{
+  struct buf *b, tmp;
+
+  acquire(&bcache.lock);
+  for(b = *bhash(dev, blockno); b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  if(b){
+    b->refcnt++;
+    bcache.st.hits++;
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    if(!b->valid){
+      virtio_disk_rw(b, 0);
+      b->valid = 1;
     }
+    memmove(dst, b->data, BSIZE);
+    brelse(b);
+    return;
+  }
+  bcache.st.misses++;
+  release(&bcache.lock);
+
+  ktrace(KT_BIO, KE_BMISS, myproc()->pid, dev, blockno, 0);
+  myproc()->u.rblocks++;
+  tmp.dev = dev;
+  tmp.blockno = blockno;
+  tmp.data = dst;
+  virtio_disk_rw(&tmp, 0);
+}
+
+// Write src to block blockno, without caching it. if the
+// block has a buffer, update that too, so that it isn't out
+// of date.
+void
+bstore(uint dev, uint blockno, uchar *src)
+{
+  struct buf *b, tmp;
+
+  acquire(&bcache.lock);
+  for(b = *bhash(dev, blockno); b; b = b->hnext)
+    if(b->dev == dev && b->blockno == blockno)
+      break;
+  if(b){
+    b->refcnt++;
+    release(&bcache.lock);
+    acquiresleep(&b->lock);
+    memmove(b->data, src, BSIZE);
+    b->valid = 1;
+    bwrite(b);
+    brelse(b);
+    return;
   }
-  panic("bget: no buffers");
+  release(&bcache.lock);
+
+  tmp.dev = dev;
+  tmp.blockno = blockno;
+  tmp.data = src;
+  virtio_disk_rw(&tmp, 1);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -96,12 +392,30 @@ bread(uint dev, uint blockno)
 
   b = bget(dev, blockno);
   if(!b->valid) {
+    ktrace(KT_BIO, KE_BMISS, myproc()->pid, dev, blockno, 0);
+    myproc()->u.rblocks++;
     virtio_disk_rw(b, 0);
     b->valid = 1;
+  } else {
+    ktrace(KT_BIO, KE_BHIT, myproc()->pid, dev, blockno, 0);
   }
   return b;
 }
 
+// Return a locked, zeroed buf for the indicated block,
+// without reading the disk, for a caller that is about
+// to overwrite all of it.
+struct buf*
+bnew(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  memset(b->data, 0, BSIZE);
+  b->valid = 1;
+  return b;
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
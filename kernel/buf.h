@@ -7,6 +7,8 @@ struct buf {
   uint refcnt;
   struct buf *prev; // LRU cache list
   struct buf *next;
-  uchar data[BSIZE];
+  struct buf *hnext; // hash chain, or spare list
+  struct buf *sib;   // next buffer sharing data's page
+  uchar *data;       // BSIZE bytes
 };
 
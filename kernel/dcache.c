@@ -0,0 +1,168 @@
+// Directory entry cache.
+//
+// Remembers (directory, name) -> inode number lookups, including
+// names known not to be there, so that namex() can usually walk a
+// path without locking and reading each directory on the way.
+//
+// Entries are only added and changed by code holding the
+// directory's sleep-lock: dirlookup(), dirlink() and unlink.
+// dcachelookup() needs only dcache.lock, and takes a reference
+// to the inode before releasing it, so unlink cannot free the
+// inode between the lookup and the iget().
+//
+// There are only entries for directories, so finding one
+// for dp means dp is a directory. a directory's entries are
+// dropped when it is freed, before its i-number is reused.
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+
+#define NDENTRY 512
+#define NDHASH  127
+
+struct dentry {
+  uint dev;
+  uint dinum;               // directory; 0 if the entry is unused
+  char name[DIRSIZ];
+  uint inum;                // 0 if name is known to be absent
+  struct dentry *hnext;     // hash chain
+  struct dentry *prev;      // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  struct dentry *hash[NDHASH];
+
+  // all entries, through prev/next. head.next is the
+  // most recently used, head.prev the least.
+  struct dentry head;
+} dcache;
+
+void
+dcacheinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+static struct dentry**
+bucket(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev * 31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h * 31 + (uchar)name[i];
+  return &dcache.hash[h % NDHASH];
+}
+
+// Move d to the front of the LRU list.
+static void
+touch(struct dentry *d)
+{
+  d->next->prev = d->prev;
+  d->prev->next = d->next;
+  d->next = dcache.head.next;
+  d->prev = &dcache.head;
+  dcache.head.next->prev = d;
+  dcache.head.next = d;
+}
+
+// Find the entry for name in dp. Caller holds dcache.lock.
+static struct dentry*
+find(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = *bucket(dp->dev, dp->inum, name); d; d = d->hnext)
+    if(d->dinum == dp->inum && d->dev == dp->dev && namecmp(d->name, name) == 0)
+      return d;
+  return 0;
+}
+
+static void
+unhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = bucket(d->dev, d->dinum, d->name); *pp != d; pp = &(*pp)->hnext)
+    ;
+  *pp = d->hnext;
+  d->dinum = 0;
+}
+
+// Look up name in directory dp without reading it.
+// Returns 0 if the cache doesn't know. Otherwise returns 1
+// and sets *ipp to the inode, referenced but not locked,
+// or to 0 if dp has no such name.
+int
+dcachelookup(struct inode *dp, char *name, struct inode **ipp)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  if((d = find(dp, name)) == 0){
+    release(&dcache.lock);
+    return 0;
+  }
+  touch(d);
+  *ipp = d->inum ? iget(d->dev, d->inum) : 0;
+  release(&dcache.lock);
+  return 1;
+}
+
+// Record that name in dp is inode inum, or is absent if
+// inum is 0. Caller must hold dp->lock.
+void
+dcacheenter(struct inode *dp, char *name, uint inum)
+{
+  struct dentry *d, **b;
+
+  acquire(&dcache.lock);
+  if((d = find(dp, name)) == 0){
+    // recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dinum)
+      unhash(d);
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    b = bucket(d->dev, d->dinum, d->name);
+    d->hnext = *b;
+    *b = d;
+  }
+  d->inum = inum;
+  touch(d);
+  release(&dcache.lock);
+}
+
+// Forget the entries of directory inum, which is being freed.
+void
+dcachepurge(uint dev, uint inum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++)
+    if(d->dinum == inum && d->dev == dev)
+      unhash(d);
+  release(&dcache.lock);
+}
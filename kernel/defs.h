@@ -1,21 +1,31 @@
+struct bcstat;
 struct buf;
 struct context;
 struct file;
 struct inode;
+struct page;
 struct pipe;
 struct proc;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct trapframe;
+struct vmspace;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bnew(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 void            bpin(struct buf*);
 void            bunpin(struct buf*);
+int             bshrink(void);
+void            bstat(struct bcstat*);
+void            bload(uint, uint, uchar*);
+void            bstore(uint, uint, uchar*);
+void            bsetsize(uint);
 
 // console.c
 void            consoleinit(void);
@@ -34,15 +44,32 @@ int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
 
+// dcache.c
+void            dcacheinit(void);
+void            dcacheenter(struct inode*, char*, uint);
+int             dcachelookup(struct inode*, char*, struct inode**);
+void            dcachepurge(uint, uint);
+
 // fs.c
 void            fsinit(int);
+void            bcommit(void);
+void            bgstat(struct bcstat*);
+int             dirempty(struct inode*);
 int             dirlink(struct inode*, char*, uint);
-struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+struct inode*   dirlookup(struct inode*, char*);
+int             dirread(struct inode*, int, uint64, uint*, uint);
+int             dirunlink(struct inode*, char*);
+struct inode*   ialloc(uint, short, uint);
 struct inode*   idup(struct inode*);
+void            iflush(struct inode*);
+void            iflushd(void);
+void            iflushwait(void);
+struct inode*   iget(uint, uint);
 void            iinit();
+int             ishrink(void);
 void            ilock(struct inode*);
 void            iput(struct inode*);
+void            isync(void);
 void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
@@ -62,6 +89,7 @@ void            ramdiskrw(struct buf*);
 // kalloc.c
 void*           kalloc(void);
 void            kfree(void *);
+uint64          kfreepages(void);
 void            kinit(void);
 
 // log.c
@@ -70,6 +98,19 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// pcache.c
+void            pcinit(void);
+struct page*    pcget(struct inode*, uint);
+void            pcput(struct page*);
+void            pcdirty(struct page*, uint);
+void            pcclean(struct page*, uint);
+int             pcdirtypages(struct inode*, uint, struct page**, int);
+int             pcisdirty(struct inode*);
+int             pctoodirty(void);
+void            pcpurge(struct inode*);
+int             pshrink(void);
+void            pcstat(struct bcstat*);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -85,11 +126,20 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
-pagetable_t     proc_pagetable(struct proc *);
-void            proc_freepagetable(pagetable_t, uint64);
+int             clone(uint64, uint64, uint64);
+int             growproc(int, uint64*);
+struct vmspace* vmcreate(struct trapframe*, int);
+void            vmput(struct vmspace*);
+void            vmleave(struct proc*);
+struct inode*   cwdget(void);
+struct inode*   cwdset(struct inode*);
+struct inode*   cwdput(struct vmspace*);
+int             vmsolo(struct proc*);
+int             futexwait(uint64, int);
+int             futexwake(uint64, int);
+int             setpriority(int, int);
 int             kill(int);
+void            kthread(void (*)(void), char*);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
 struct proc*    myproc();
@@ -98,13 +148,35 @@ void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
-int             wait(uint64);
+int             waitpid(int, uint64);
+int             getrusage(int, uint64);
+int             procinfo(uint64, int);
+int             cpuinfo(uint64, int);
 void            wakeup(void*);
 void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 
+// sched.c
+void            schedinit(void);
+void            setrunnable(struct proc*);
+struct proc*    schedpick(void);
+void            schedswitch(struct proc*, int);
+int             schedyield(int);
+
+// ktrace.c
+void            ktraceinit(void);
+void            ktrace(int, int, int, uint64, uint64, char*);
+
+// prof.c
+void            profinit(void);
+void            profintr(int, uint64);
+
+// ring.c
+int             ringcopy(struct vmspace*, struct vmspace*);
+void            ringfree(struct vmspace*);
+
 // swtch.S
 void            swtch(struct context*, struct context*);
 
@@ -115,6 +187,8 @@ void            initlock(struct spinlock*, char*);
 void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
+int             tryacquire(struct spinlock*);
+int             lockstats(uint64, int);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -138,9 +212,11 @@ int             argaddr(int, uint64 *);
 int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
+uint64          syscallrun(int);
 
 // trap.c
 extern uint     ticks;
+uint64          clocknsec(void);
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
@@ -166,6 +242,7 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
 int             copyin(pagetable_t, char *, uint64, uint64);
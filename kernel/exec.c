@@ -16,9 +16,10 @@ exec(char *path, char **argv)
   int i, off;
   uint64 argc, sz = 0, sp, ustack[MAXARG], stackbase;
   struct elfhdr elf;
-  struct inode *ip;
+  struct inode *ip, *cwd;
   struct proghdr ph;
-  pagetable_t pagetable = 0, oldpagetable;
+  pagetable_t pagetable = 0;
+  struct vmspace *vm = 0;
   struct proc *p = myproc();
 
   begin_op();
@@ -35,8 +36,11 @@ exec(char *path, char **argv)
   if(elf.magic != ELF_MAGIC)
     goto bad;
 
-  if((pagetable = proc_pagetable(p)) == 0)
+  // a new address space, with p's trapframe in slot 0. if p is
+  // a thread, the other threads keep running in the old one.
+  if((vm = vmcreate(p->trapframe, p->pid)) == 0)
     goto bad;
+  pagetable = vm->pagetable;
 
   // Load program into memory.
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
@@ -62,7 +66,6 @@ exec(char *path, char **argv)
   ip = 0;
 
   p = myproc();
-  uint64 oldsz = p->sz;
 
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
@@ -108,19 +111,37 @@ exec(char *path, char **argv)
       last = s+1;
   safestrcpy(p->name, last, sizeof(p->name));
     
-  // Commit to the user image.
-  oldpagetable = p->pagetable;
+  // the other threads run in the old address space,
+  // so they go first.
+  if(vmsolo(p) < 0)
+    goto bad;
+
+  // Commit to the user image. the new address space
+  // starts in p's directory.
+  vm->cwd = cwdget();
+  vm->nlive = 1;
+  cwd = cwdput(p->vm);
+  vmleave(p);
+  vm->sz = sz;
+  p->vm = vm;
   p->pagetable = pagetable;
-  p->sz = sz;
+  p->tfslot = 0;
+  p->trapframe->tp = USYSCALLPID(0);
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  proc_freepagetable(oldpagetable, oldsz);
+  if(cwd){
+    begin_op();
+    iput(cwd);
+    end_op();
+  }
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
-  if(pagetable)
-    proc_freepagetable(pagetable, sz);
+  if(vm){
+    vm->sz = sz;
+    vmput(vm);
+  }
   if(ip){
     iunlockput(ip);
     end_op();
@@ -119,7 +119,9 @@ fileread(struct file *f, uint64 addr, int n)
     r = devsw[f->major].read(1, addr, n);
   } else if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
+    if(f->ip->type == T_DIR)
+      r = dirread(f->ip, 1, addr, &f->off, n);
+    else if((r = readi(f->ip, 1, addr, f->off, n)) > 0)
       f->off += r;
     iunlock(f->ip);
   } else {
@@ -145,14 +147,41 @@ filewrite(struct file *f, uint64 addr, int n)
     if(f->major < 0 || f->major >= NDEV || !devsw[f->major].write)
       return -1;
     ret = devsw[f->major].write(1, addr, n);
+  } else if(f->type == FD_INODE && f->ip->type == T_FILE){
+    // a regular file's data goes to the page cache, and
+    // iflush() writes it back in transactions of its own,
+    // so the write needn't be split up to fit the log.
+    int i = 0, stuck = 0;
+    while(i < n){
+      ilock(f->ip);
+      if((r = writei(f->ip, 1, addr + i, f->off, n - i)) > 0)
+        f->off += r;
+      iunlock(f->ip);
+      if(r < 0)
+        break;
+      i += r;
+      // if the page cache was full, write this file back;
+      // if too much is still dirty, wait for iflushd() to
+      // write back the rest. give up if that doesn't help.
+      if(r == 0 && stuck++)
+        break;
+      if(r > 0)
+        stuck = 0;
+      if(i < n)
+        iflush(f->ip);
+      if(pctoodirty())
+        iflushwait();
+    }
+    ret = (i == n ? n : -1);
   } else if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
+    // i-node, indirect block or two extent blocks and
+    // the new one's allocation block, allocation blocks,
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
-    int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+    int max = ((MAXOPBLOCKS-1-3-2) / 2) * BSIZE;
     int i = 0;
     while(i < n){
       int n1 = n - i;
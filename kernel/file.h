@@ -18,6 +18,10 @@ struct inode {
   uint dev;           // Device number
   uint inum;          // Inode number
   int ref;            // Reference count
+  struct inode *hnext;   // itable hash chain
+  struct inode *prev;    // itable LRU list, while ref is 0
+  struct inode *next;
+  struct page *pages;    // page cache pages, through inext; pcache.lock
   struct sleeplock lock; // protects everything below here
   int valid;          // inode has been read from disk?
 
@@ -26,7 +30,23 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint dsize;         // size the disk has blocks and data for
+  int dirty;          // on idirty's list; see isync()
+  struct inode *dnext;
+  union {
+    uint addrs[NDIRECT+1];
+    struct {
+      struct extent ext[NEXTENT];
+      uint nblocks;
+      uint xhead;
+      uint xtail;
+    };
+  };
+
+  // the extent bmap() last found, to map the rest of
+  // its run without searching.
+  struct extent cur;
+  uint curbn;         // first file block cur maps
 };
 
 // map major device number to device functions.
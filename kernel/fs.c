@@ -19,14 +19,17 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "pcache.h"
 #include "file.h"
+#include "bcstat.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
 
-// Read the super block.
+// Read the super block, MINBSIZE bytes into the disk:
+// block 1 while the buffers are MINBSIZE bytes.
 static void
 readsb(int dev, struct superblock *sb)
 {
@@ -37,13 +40,25 @@ readsb(int dev, struct superblock *sb)
   brelse(bp);
 }
 
+static void bcount(int);
+static void icount(int);
+
 // Init fs
 void
 fsinit(int dev) {
   readsb(dev, &sb);
   if(sb.magic != FSMAGIC)
     panic("invalid file system");
+  if(sb.bsize == 0)
+    sb.bsize = MINBSIZE;
+  if(sb.bsize < MINBSIZE || sb.bsize > MAXBSIZE || (sb.bsize & (sb.bsize - 1)))
+    panic("fsinit: block size");
+  if(sb.bsize != BSIZE)
+    bsetsize(sb.bsize);
   initlog(dev, &sb);
+  bcount(dev);
+  icount(dev);
+  kthread(iflushd, "flushd");
 }
 
 // Zero a block.
@@ -52,40 +67,215 @@ bzero(int dev, int bno)
 {
   struct buf *bp;
 
-  bp = bread(dev, bno);
-  memset(bp->data, 0, BSIZE);
+  bp = bnew(dev, bno);
   log_write(bp);
   brelse(bp);
 }
 
 // Blocks.
+//
+// Each bitmap block covers a group of BPB blocks. bgroups
+// keeps a count of each group's free blocks, so that
+// balloc() reads only bitmap blocks with free blocks in
+// them, and where the last allocation ended, where the next
+// one starts looking if the caller has no better idea.
+// it also counts the blocks promised to file data that is
+// only in the page cache so far; see breserve().
+//
+// a block bfree() frees can't be allocated again until the
+// transaction that frees it commits, so that iflush() can't
+// give it to another file and write that file's data over it
+// in place while a crash would still leave it in the first
+// file. freeing[g] has a bit set for each such block in
+// group g, and nfree doesn't count them yet.
+//
+// a group's bitmap block's sleep-lock protects its bits and
+// its freeing bits; bgroups.lock protects the counts and the
+// cursor.
 
-// Allocate a zeroed disk block.
-static uint
-balloc(uint dev)
+struct {
+  struct spinlock lock;
+  uint *nfree;       // free blocks in each group
+  uint ngroup;
+  uint cursor;
+  uint reserved;     // free blocks promised to delayed writes
+  uint *nfreeing;    // blocks in each group freed since the commit
+  uchar **freeing;   // and their bits, laid out like the bitmap's
+} bgroups;
+
+// Count the free blocks in each group.
+static void
+bcount(int dev)
 {
-  int b, bi, m;
   struct buf *bp;
+  uint g, b, end;
+  uchar *page = 0;
+
+  initlock(&bgroups.lock, "bgroups");
+  bgroups.ngroup = (sb.size + BPB - 1) / BPB;
+  if(bgroups.ngroup * sizeof(uchar*) > PGSIZE ||
+     (bgroups.nfree = kalloc()) == 0 ||
+     (bgroups.nfreeing = kalloc()) == 0 ||
+     (bgroups.freeing = kalloc()) == 0)
+    panic("bcount");
+  for(g = 0; g < bgroups.ngroup; g++){
+    if(g % (PGSIZE / BSIZE) == 0){
+      if((page = kalloc()) == 0)
+        panic("bcount");
+      memset(page, 0, PGSIZE);
+    }
+    bgroups.freeing[g] = page + (g % (PGSIZE / BSIZE)) * BSIZE;
+    bgroups.nfreeing[g] = 0;
+    bgroups.nfree[g] = 0;
+    end = min((g+1)*BPB, sb.size);
+    bp = bread(dev, BBLOCK(g*BPB, sb));
+    for(b = g*BPB; b < end; b++)
+      if((bp->data[(b%BPB)/8] & (1 << (b%8))) == 0)
+        bgroups.nfree[g]++;
+    brelse(bp);
+  }
+  bgroups.cursor = sb.size - sb.nblocks;
+}
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+// Mark free blocks in group g allocated: the first free
+// block at or after from, and up to *n-1 free blocks right
+// after it. Returns the first, and sets *n to the number
+// allocated, or returns 0 if there are none.
+static uint
+galloc(uint dev, uint g, uint from, uint *n)
+{
+  struct buf *bp;
+  uint64 *w;
+  uchar *f = bgroups.freeing[g];
+  uint b, bi, end, i;
+
+  end = min((g+1)*BPB, sb.size);
+  bp = bread(dev, BBLOCK(g*BPB, sb));
+  w = (uint64*)bp->data;
+  for(b = from; b < end; b++){
+    bi = b % BPB;
+    // skip 64 allocated blocks at a time.
+    while(bi % 64 == 0 && w[bi/64] == ~0ULL && b + 64 <= end){
+      b += 64;
+      bi += 64;
     }
+    if(b >= end)
+      break;
+    if((bp->data[bi/8] | f[bi/8]) & (1 << (bi%8)))
+      continue;
+    for(i = 0; i < *n && b + i < end; i++){
+      bi = (b + i) % BPB;
+      if((bp->data[bi/8] | f[bi/8]) & (1 << (bi%8)))
+        break;
+      bp->data[bi/8] |= 1 << (bi%8);
+    }
+    log_write(bp);
     brelse(bp);
+    *n = i;
+    return b;
   }
-  panic("balloc: out of blocks");
+  brelse(bp);
+  return 0;
 }
 
-// Free a disk block.
+// Allocate up to *n disk blocks in a row, starting at goal
+// if it's free, else at the next free block after it. goal 0
+// means wherever the last allocation ended. the blocks are
+// zeroed if zero is set. Sets *n to the number allocated,
+// and returns the first. Returns 0 if the disk is full.
+static uint
+ballocrun(uint dev, uint goal, uint *n, int zero)
+{
+  uint g, i, b, from;
+
+  acquire(&bgroups.lock);
+  if(goal == 0 || goal >= sb.size)
+    goal = bgroups.cursor;
+  release(&bgroups.lock);
+
+  // the rest of goal's group, the groups after it,
+  // then the start of goal's group.
+  for(i = 0; i <= bgroups.ngroup; i++){
+    g = (goal / BPB + i) % bgroups.ngroup;
+    from = i == 0 ? goal : g*BPB;
+    acquire(&bgroups.lock);
+    if(bgroups.nfree[g] == 0){
+      release(&bgroups.lock);
+      continue;
+    }
+    release(&bgroups.lock);
+    if((b = galloc(dev, g, from, n)) != 0){
+      acquire(&bgroups.lock);
+      bgroups.nfree[g] -= *n;
+      bgroups.cursor = b + *n;
+      release(&bgroups.lock);
+      for(i = 0; zero && i < *n; i++)
+        bzero(dev, b + i);
+      return b;
+    }
+  }
+  printf("balloc: out of blocks\n");
+  return 0;
+}
+
+// Allocate a zeroed disk block, at goal if it's free.
+// Returns 0 if the disk is full.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint n = 1;
+
+  return ballocrun(dev, goal, &n, 1);
+}
+
+// Allocate a block for ip's data. a regular file's blocks
+// are only allocated by iflush(), which writes them in full
+// right away, so they need not be zeroed through the log.
+static uint
+dalloc(struct inode *ip)
+{
+  uint n = 1;
+
+  return ballocrun(ip->dev, 0, &n, ip->type != T_FILE);
+}
+
+// blocks breserve() keeps back for the extent and indirect
+// blocks that writing data back may need, and for directories.
+#define NRESERVE 64
+
+// Promise n free blocks to file data that is so far only in
+// the page cache, so that iflush() will find blocks for it.
+// Returns 0, or -1 if there aren't enough blocks.
+static int
+breserve(uint n)
+{
+  uint g, nfree;
+
+  acquire(&bgroups.lock);
+  nfree = 0;
+  for(g = 0; g < bgroups.ngroup; g++)
+    nfree += bgroups.nfree[g];
+  if(nfree < bgroups.reserved + n + NRESERVE){
+    release(&bgroups.lock);
+    return -1;
+  }
+  bgroups.reserved += n;
+  release(&bgroups.lock);
+  return 0;
+}
+
+// Return the promise of n blocks, which have been allocated,
+// or are no longer needed.
+static void
+bunreserve(uint n)
+{
+  acquire(&bgroups.lock);
+  bgroups.reserved -= n;
+  release(&bgroups.lock);
+}
+
+// Free a disk block. it can be allocated again once the
+// transaction commits.
 static void
 bfree(int dev, uint b)
 {
@@ -98,8 +288,45 @@ bfree(int dev, uint b)
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
+  bgroups.freeing[b / BPB][bi/8] |= m;
   log_write(bp);
   brelse(bp);
+  acquire(&bgroups.lock);
+  bgroups.nfreeing[b / BPB]++;
+  release(&bgroups.lock);
+}
+
+// The transaction is about to commit, and no FS system call
+// is running to allocate blocks before it does: let the
+// blocks it freed be allocated again.
+void
+bcommit(void)
+{
+  uint g;
+
+  for(g = 0; g < bgroups.ngroup; g++){
+    if(bgroups.nfreeing[g] == 0)
+      continue;
+    memset(bgroups.freeing[g], 0, BSIZE);
+    acquire(&bgroups.lock);
+    bgroups.nfree[g] += bgroups.nfreeing[g];
+    bgroups.nfreeing[g] = 0;
+    release(&bgroups.lock);
+  }
+}
+
+// Report each group's free blocks.
+void
+bgstat(struct bcstat *st)
+{
+  uint g;
+
+  acquire(&bgroups.lock);
+  st->ngroup = bgroups.ngroup;
+  st->groupsize = BPB;
+  for(g = 0; g < NBCGROUP; g++)
+    st->gfree[g] = g < bgroups.ngroup ? bgroups.nfree[g] : 0;
+  release(&bgroups.lock);
 }
 
 // Inodes.
@@ -127,18 +354,18 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, and iput() frees if
 //   the reference and link counts have fallen to zero.
 //
-// * Referencing in table: an entry in the inode table
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() finds or
-//   creates a table entry and increments its ref; iput()
-//   decrements ref.
+// * Referencing in table: ip->ref tracks the number of
+//   in-memory pointers to the entry (open files and current
+//   directories). iget() finds or creates a table entry and
+//   increments its ref; iput() decrements ref. an entry
+//   whose ref is zero stays in the table, on an LRU list,
+//   until iget() needs it for another inode.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   table entry is only correct when ip->valid is 1.
-//   ilock() reads the inode from
-//   the disk and sets ip->valid, while iput() clears
-//   ip->valid if ip->ref has fallen to zero.
+//   ilock() reads the inode from the disk and sets
+//   ip->valid, while iput() clears ip->valid if it frees
+//   the inode.
 //
 // * Locked: file system code may only examine and modify
 //   the information in an inode and its content if it
@@ -162,56 +389,154 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
+// The table's entries are kalloc()ed a page at a time when
+// all of them are referenced, up to a limit set by the size
+// of memory, and found through a hash table on (dev, inum).
+//
 // The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// entries. Since ip->ref indicates whether an entry is in use,
 // and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold itable.lock while using any of those fields.
+// holds, one must hold itable.lock while using any of those
+// fields, or the hash and LRU links.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define NIHASH 127
+#define IPERPAGE (PGSIZE / sizeof(struct inode))
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *hash[NIHASH];
+  struct inode *free;   // entries never used, through hnext
+  int n;                // entries allocated
+  int max;              // most entries there may be
+
+  // entries whose ref is 0, through prev/next.
+  // lru.next is the least recently used.
+  struct inode lru;
 } itable;
 
+// Regular files with dirty pages, each holding a reference
+// that keeps it in the table until isync() writes it back.
+struct {
+  struct spinlock lock;
+  struct inode *head;     // through dnext
+  struct sleeplock sync;  // one isync() at a time
+  uint gen;               // isync()s finished
+  int kick;               // a writer is waiting for iflushd()
+} idirty;
+
 void
 iinit()
 {
-  int i = 0;
-  
   initlock(&itable.lock, "itable");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&itable.inode[i].lock, "inode");
-  }
+  itable.lru.prev = &itable.lru;
+  itable.lru.next = &itable.lru;
+  // up to 1/64th of memory.
+  itable.max = kfreepages() / 64 * IPERPAGE;
+  if(itable.max < NINODE)
+    itable.max = NINODE;
+  initlock(&idirty.lock, "idirty");
+  initsleeplock(&idirty.sync, "isync");
 }
 
-static struct inode* iget(uint dev, uint inum);
+// A bit for each inode, set if the inode is free, so that
+// ialloc() need not read the inode blocks to find one.
+// ifree.lock protects the bits; taking an inode's bit
+// gives the taker the on-disk inode.
+struct {
+  struct spinlock lock;
+  uint64 *free;
+  uint dircursor;    // where to look for a new directory's inode
+} ifree;
 
-// Allocate an inode on device dev.
-// Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
-struct inode*
-ialloc(uint dev, short type)
+// Find the free inodes.
+static void
+icount(int dev)
 {
-  int inum;
   struct buf *bp;
   struct dinode *dip;
+  uint inum;
 
+  initlock(&ifree.lock, "ifree");
+  if((sb.ninodes + 63) / 64 * sizeof(uint64) > PGSIZE || (ifree.free = kalloc()) == 0)
+    panic("icount");
+  memset(ifree.free, 0, PGSIZE);
   for(inum = 1; inum < sb.ninodes; inum++){
     bp = bread(dev, IBLOCK(inum, sb));
     dip = (struct dinode*)bp->data + inum%IPB;
-    if(dip->type == 0){  // a free inode
-      memset(dip, 0, sizeof(*dip));
-      dip->type = type;
-      log_write(bp);   // mark it allocated on the disk
-      brelse(bp);
-      return iget(dev, inum);
-    }
+    if(dip->type == 0)
+      ifree.free[inum/64] |= 1ULL << (inum%64);
     brelse(bp);
   }
-  panic("ialloc: no inodes");
+  ifree.dircursor = ROOTINO;
+}
+
+// Take the first free inode at or after inum, wrapping
+// around. Returns 0 if there are none. Caller must
+// hold ifree.lock.
+static uint
+itake(uint inum)
+{
+  uint i, n, w;
+  uint64 bits;
+
+  n = (sb.ninodes + 63) / 64;
+  for(i = 0; i <= n; i++){
+    w = (inum / 64 + i) % n;
+    // in the first word, skip the bits below inum.
+    bits = ifree.free[w];
+    if(i == 0)
+      bits &= ~0ULL << (inum % 64);
+    if(bits == 0)
+      continue;
+    for(inum = w*64; (bits & 1) == 0; bits >>= 1)
+      inum++;
+    ifree.free[w] &= ~(1ULL << (inum%64));
+    return inum;
+  }
+  return 0;
+}
+
+// Allocate an inode on device dev.
+// Mark it as allocated by  giving it type type.
+// A file's inode is put near its directory's, near, and a
+// directory's after the last directory's, leaving room
+// for each directory's files.
+// Returns an unlocked but allocated and referenced inode,
+// or 0 if there are no free inodes.
+struct inode*
+ialloc(uint dev, short type, uint near)
+{
+  uint inum;
+  struct buf *bp;
+  struct dinode *dip;
+
+  acquire(&ifree.lock);
+  if(type == T_DIR){
+    inum = itake(ifree.dircursor);
+    if(inum)
+      ifree.dircursor = inum + IPB;
+  } else {
+    inum = itake(near);
+  }
+  release(&ifree.lock);
+  if(inum == 0){
+    printf("ialloc: no inodes\n");
+    return 0;
+  }
+
+  bp = bread(dev, IBLOCK(inum, sb));
+  dip = (struct dinode*)bp->data + inum%IPB;
+  if(dip->type != 0)
+    panic("ialloc: inode in use");
+  memset(dip, 0, sizeof(*dip));
+  dip->type = type;
+  log_write(bp);   // mark it allocated on the disk
+  brelse(bp);
+  return iget(dev, inum);
 }
 
 // Copy a modified in-memory inode to disk.
@@ -230,48 +555,149 @@ iupdate(struct inode *ip)
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
+  // a regular file's data past dsize is only in the page
+  // cache, and has no blocks yet.
+  dip->size = ip->type == T_FILE ? ip->dsize : ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
 }
 
+static struct inode**
+ihash(uint dev, uint inum)
+{
+  return &itable.hash[(dev * 31 + inum) % NIHASH];
+}
+
+// Add the page of entries at page to itable.free.
+// Caller holds itable.lock.
+static void
+igrow(char *page)
+{
+  struct inode *ip;
+  int i;
+
+  memset(page, 0, PGSIZE);
+  ip = (struct inode*)page;
+  for(i = 0; i < IPERPAGE; i++, ip++){
+    initsleeplock(&ip->lock, "inode");
+    ip->hnext = itable.free;
+    itable.free = ip;
+  }
+  itable.n += IPERPAGE;
+}
+
+static void
+lruremove(struct inode *ip)
+{
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
-static struct inode*
+struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip, **pp;
+  char *page;
+  int grown = 0;
 
   acquire(&itable.lock);
 
+again:
   // Is the inode already in the table?
-  empty = 0;
-  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
+  for(ip = *ihash(dev, inum); ip; ip = ip->hnext){
+    if(ip->dev == dev && ip->inum == inum){
+      if(ip->ref++ == 0)
+        lruremove(ip);
       release(&itable.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode entry.
-  if(empty == 0)
+  // Take a new entry, or recycle the least recently used
+  // unreferenced one. only if every entry is in use, add a
+  // page of them; kalloc() may call ishrink(), so let go
+  // of the lock.
+  if((ip = itable.free) != 0){
+    itable.free = ip->hnext;
+  } else if((ip = itable.lru.next) != &itable.lru){
+    lruremove(ip);
+    pcpurge(ip);
+    for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+      ;
+    *pp = ip->hnext;
+  } else if(itable.n < itable.max && !grown){
+    release(&itable.lock);
+    page = kalloc();
+    acquire(&itable.lock);
+    if(page)
+      igrow(page);
+    grown = 1;
+    goto again;
+  } else {
     panic("iget: no inodes");
+  }
 
-  ip = empty;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
+  pp = ihash(dev, inum);
+  ip->hnext = *pp;
+  *pp = ip;
   release(&itable.lock);
 
   return ip;
 }
 
+// Give a page of table entries that are all unused back to
+// kalloc(), which is out of memory. Returns 1 if there was one.
+int
+ishrink(void)
+{
+  struct inode *ip, *page, **pp;
+  int i;
+
+  acquire(&itable.lock);
+  for(ip = itable.lru.next; ip != &itable.lru; ip = ip->next){
+    page = (struct inode*)PGROUNDDOWN((uint64)ip);
+    for(i = 0; i < IPERPAGE && page[i].ref == 0; i++)
+      ;
+    if(i == IPERPAGE)
+      break;
+  }
+  if(ip == &itable.lru){
+    release(&itable.lock);
+    return 0;
+  }
+
+  // the page's entries are on the LRU list and hashed, or
+  // on the free list, where prev is 0.
+  for(i = 0; i < IPERPAGE; i++){
+    ip = &page[i];
+    if(ip->prev){
+      lruremove(ip);
+      pcpurge(ip);
+      for(pp = ihash(ip->dev, ip->inum); *pp != ip; pp = &(*pp)->hnext)
+        ;
+      *pp = ip->hnext;
+    }
+  }
+  for(pp = &itable.free; *pp; ){
+    if(*pp >= page && *pp < page + IPERPAGE)
+      *pp = (*pp)->hnext;
+    else
+      pp = &(*pp)->hnext;
+  }
+  itable.n -= IPERPAGE;
+  release(&itable.lock);
+  kfree(page);
+  return 1;
+}
+
 // Increment reference count for ip.
 // Returns ip to enable ip = idup(ip1) idiom.
 struct inode*
@@ -304,8 +730,10 @@ ilock(struct inode *ip)
     ip->minor = dip->minor;
     ip->nlink = dip->nlink;
     ip->size = dip->size;
+    ip->dsize = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->cur.len = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -324,7 +752,7 @@ iunlock(struct inode *ip)
 
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode table entry can
-// be recycled.
+// be recycled, but keeps the inode until it is.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -343,17 +771,34 @@ iput(struct inode *ip)
 
     release(&itable.lock);
 
+    if(ip->type == T_DIR)
+      dcachepurge(ip->dev, ip->inum);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
     ip->valid = 0;
+    acquire(&ifree.lock);
+    ifree.free[ip->inum/64] |= 1ULL << (ip->inum%64);
+    release(&ifree.lock);
 
     releasesleep(&ip->lock);
 
     acquire(&itable.lock);
   }
 
-  ip->ref--;
+  if(--ip->ref == 0){
+    // most recently used; a freed inode is of no more
+    // use, so it goes first in line for recycling.
+    if(ip->valid){
+      ip->prev = itable.lru.prev;
+      ip->next = &itable.lru;
+    } else {
+      ip->prev = &itable.lru;
+      ip->next = itable.lru.next;
+    }
+    ip->prev->next = ip;
+    ip->next->prev = ip;
+  }
   release(&itable.lock);
 }
 
@@ -368,34 +813,227 @@ iunlockput(struct inode *ip)
 // Inode content
 //
 // The content (data) associated with each inode is stored
-// in blocks on the disk. The first NDIRECT block numbers
-// are listed in ip->addrs[].  The next NINDIRECT blocks are
+// in blocks on the disk. With FS_EXTENTS, ip->ext[] and
+// the extent blocks from ip->xhead list runs of blocks; see
+// xmap(). Otherwise the first NDIRECT block numbers are
+// listed in ip->addrs[], and the next NINDIRECT blocks are
 // listed in block ip->addrs[NDIRECT].
 
+// Add the len blocks from addr to the end of ip's last
+// extent if they follow it, else start a new extent, in a
+// new extent block if need be. Leaves ip->cur at the last
+// extent. Returns 0, or -1 if the disk is full.
+static int
+xappend(struct inode *ip, uint addr, uint len)
+{
+  struct buf *bp;
+  struct xblock *xb;
+  struct extent *e;
+  uint nb;
+  int i;
+
+  bp = 0;
+  if(ip->xtail == 0){
+    for(i = NEXTENT; i > 0 && ip->ext[i-1].len == 0; i--)
+      ;
+    if(i > 0 && ip->ext[i-1].start + ip->ext[i-1].len == addr){
+      e = &ip->ext[i-1];
+      e->len += len;
+      goto done;
+    }
+    if(i < NEXTENT){
+      e = &ip->ext[i];
+      e->start = addr;
+      e->len = len;
+      goto done;
+    }
+  } else {
+    bp = bread(ip->dev, ip->xtail);
+    xb = (struct xblock*)bp->data;
+    e = &xb->ext[xb->n-1];
+    if(e->start + e->len == addr){
+      e->len += len;
+      log_write(bp);
+      goto done;
+    }
+    if(xb->n < NXEXTENT){
+      e = &xb->ext[xb->n++];
+      e->start = addr;
+      e->len = len;
+      log_write(bp);
+      goto done;
+    }
+  }
+
+  // the inode, or the last extent block, is full.
+  if((nb = balloc(ip->dev, 0)) == 0){
+    if(bp)
+      brelse(bp);
+    return -1;
+  }
+  if(bp){
+    ((struct xblock*)bp->data)->next = nb;
+    log_write(bp);
+    brelse(bp);
+  } else {
+    ip->xhead = nb;
+  }
+  ip->xtail = nb;
+  bp = bread(ip->dev, nb);
+  xb = (struct xblock*)bp->data;
+  xb->n = 1;
+  e = &xb->ext[0];
+  e->start = addr;
+  e->len = len;
+  log_write(bp);
+
+done:
+  ip->nblocks += len;
+  ip->cur = *e;
+  ip->curbn = ip->nblocks - e->len;
+  if(bp)
+    brelse(bp);
+  return 0;
+}
+
+// The block just after ip's last block, where the file
+// would best grow. a file's first block goes in the part
+// of the data blocks matching its place in the inodes, so
+// that files near each other in the inodes, like those in
+// one directory, are near each other on the disk, and
+// files written at the same time don't interleave.
+static uint
+xgoal(struct inode *ip)
+{
+  struct buf *bp;
+  struct xblock *xb;
+  int i;
+
+  if(ip->nblocks == 0)
+    return sb.size - sb.nblocks + (uint64)ip->inum * sb.nblocks / sb.ninodes;
+  if(ip->cur.len == 0 || ip->curbn + ip->cur.len != ip->nblocks){
+    if(ip->xtail){
+      bp = bread(ip->dev, ip->xtail);
+      xb = (struct xblock*)bp->data;
+      ip->cur = xb->ext[xb->n-1];
+      brelse(bp);
+    } else {
+      for(i = NEXTENT; ip->ext[i-1].len == 0; i--)
+        ;
+      ip->cur = ip->ext[i-1];
+    }
+    ip->curbn = ip->nblocks - ip->cur.len;
+  }
+  return ip->cur.start + ip->cur.len;
+}
+
+// Allocate blocks to ip until it has want of them, or has
+// taken nrun runs, which bounds the blocks logged. takes runs
+// that continue the file's last run where possible. Returns
+// 0, or -1 if the disk filled up.
+static int
+xgrow(struct inode *ip, uint want, int nrun)
+{
+  uint addr, n, i;
+
+  while(ip->nblocks < want && nrun-- > 0){
+    n = want - ip->nblocks;
+    if((addr = ballocrun(ip->dev, xgoal(ip), &n, ip->type != T_FILE)) == 0)
+      return -1;
+    if(xappend(ip, addr, n) < 0){
+      for(i = 0; i < n; i++)
+        bfree(ip->dev, addr + i);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// bmap() for FS_EXTENTS. ip->cur caches the last extent
+// found, so reading or writing a run in order searches the
+// extents once for the whole run.
+static uint
+xmap(struct inode *ip, uint bn)
+{
+  struct buf *bp;
+  struct xblock *xb;
+  struct extent *e;
+  uint b, next, lbn;
+  int i;
+
+  if(bn >= ip->nblocks){
+    if(bn > ip->nblocks)
+      panic("xmap: hole");
+    if(xgrow(ip, bn + 1, 1) < 0)
+      return 0;
+  }
+
+  if(bn >= ip->curbn && bn - ip->curbn < ip->cur.len)
+    return ip->cur.start + (bn - ip->curbn);
+
+  // search the extents in the inode, then the extent blocks.
+  lbn = 0;
+  for(i = 0; i < NEXTENT; i++){
+    e = &ip->ext[i];
+    if(bn - lbn < e->len){
+      ip->cur = *e;
+      ip->curbn = lbn;
+      return e->start + (bn - lbn);
+    }
+    lbn += e->len;
+  }
+  for(b = ip->xhead; b; b = next){
+    bp = bread(ip->dev, b);
+    xb = (struct xblock*)bp->data;
+    for(i = 0; i < xb->n; i++){
+      e = &xb->ext[i];
+      if(bn - lbn < e->len){
+        ip->cur = *e;
+        ip->curbn = lbn;
+        brelse(bp);
+        return e->start + (bn - lbn);
+      }
+      lbn += e->len;
+    }
+    next = xb->next;
+    brelse(bp);
+  }
+  panic("xmap: missing block");
+}
+
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
+// Returns 0 if the disk is full.
 static uint
 bmap(struct inode *ip, uint bn)
 {
   uint addr, *a;
   struct buf *bp;
 
+  if(sb.features & FS_EXTENTS)
+    return xmap(ip, bn);
+
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = dalloc(ip);
     return addr;
   }
   bn -= NDIRECT;
 
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
-    if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
+    if((addr = ip->addrs[NDIRECT]) == 0){
+      if((addr = balloc(ip->dev, 0)) == 0)
+        return 0;
+      ip->addrs[NDIRECT] = addr;
+    }
     bp = bread(ip->dev, addr);
     a = (uint*)bp->data;
     if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
+      if((addr = dalloc(ip)) != 0){
+        a[bn] = addr;
+        log_write(bp);
+      }
     }
     brelse(bp);
     return addr;
@@ -404,6 +1042,59 @@ bmap(struct inode *ip, uint bn)
   panic("bmap: out of range");
 }
 
+// Free the blocks of extent e.
+static void
+xfree(uint dev, struct extent *e)
+{
+  uint b;
+
+  for(b = e->start; b < e->start + e->len; b++)
+    bfree(dev, b);
+}
+
+// Number of ip's blocks, from the start, that have disk
+// blocks. a regular file's blocks past these are only in the
+// page cache, until iflush() allocates blocks for them.
+static uint
+nalloc(struct inode *ip)
+{
+  if(sb.features & FS_EXTENTS)
+    return ip->nblocks;
+  return (ip->dsize + BSIZE - 1) / BSIZE;
+}
+
+// Number of ip's blocks that breserve() holds disk blocks for.
+static uint
+ndelayed(struct inode *ip)
+{
+  uint n = (ip->size + BSIZE - 1) / BSIZE;
+
+  if(ip->type != T_FILE || n <= nalloc(ip))
+    return 0;
+  return n - nalloc(ip);
+}
+
+// Where ip's block bn is on the disk, or 0 if it has none.
+// for the block just after the last one with a disk block,
+// where the allocator would start looking for one.
+// Caller must hold ip->lock.
+static uint
+iblock(struct inode *ip, uint bn)
+{
+  uint b;
+
+  if(bn < nalloc(ip))
+    return bmap(ip, bn);
+  if(bn > nalloc(ip))
+    return 0;
+  if(sb.features & FS_EXTENTS)
+    return xgoal(ip);
+  acquire(&bgroups.lock);
+  b = bgroups.cursor;
+  release(&bgroups.lock);
+  return b;
+}
+
 // Truncate inode (discard contents).
 // Caller must hold ip->lock.
 void
@@ -411,7 +1102,32 @@ itrunc(struct inode *ip)
 {
   int i, j;
   struct buf *bp;
-  uint *a;
+  struct xblock *xb;
+  uint *a, b, next;
+
+  // drop the data, and the blocks promised to what wasn't
+  // written back.
+  bunreserve(ndelayed(ip));
+  pcpurge(ip);
+  ip->dsize = 0;
+  if(sb.features & FS_EXTENTS){
+    for(i = 0; i < NEXTENT; i++)
+      xfree(ip->dev, &ip->ext[i]);
+    for(b = ip->xhead; b; b = next){
+      bp = bread(ip->dev, b);
+      xb = (struct xblock*)bp->data;
+      for(i = 0; i < xb->n; i++)
+        xfree(ip->dev, &xb->ext[i]);
+      next = xb->next;
+      brelse(bp);
+      bfree(ip->dev, b);
+    }
+    memset(ip->addrs, 0, sizeof(ip->addrs));
+    ip->cur.len = 0;
+    ip->size = 0;
+    iupdate(ip);
+    return;
+  }
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -446,17 +1162,48 @@ stati(struct inode *ip, struct stat *st)
   st->type = ip->type;
   st->nlink = ip->nlink;
   st->size = ip->size;
+  st->blksize = BSIZE;
+  st->addr0 = nalloc(ip) > 0 ? iblock(ip, 0) : 0;
+  st->goal = iblock(ip, nalloc(ip));
+}
+
+// Read the blocks in mask need of page pg of ip that it
+// doesn't have yet from the disk, or the buffer cache.
+// Caller must hold ip->lock.
+static void
+pfill(struct inode *ip, struct page *pg, uint need)
+{
+  uint bn, addr;
+  int i;
+
+  for(i = 0; i < PGSIZE/BSIZE; i++){
+    if(!(need & (1 << i)) || (pg->valid & (1 << i)))
+      continue;
+    bn = pg->pgno * (PGSIZE/BSIZE) + i;
+    // past the data on the disk, the page is zero until
+    // writei() fills it in. data written past dsize is
+    // always in a dirty page, so never read in here.
+    if(bn*BSIZE >= ip->dsize || (addr = bmap(ip, bn)) == 0)
+      memset(pg->data + i*BSIZE, 0, BSIZE);
+    else
+      bload(ip->dev, addr, pg->data + i*BSIZE);
+  }
+  pg->valid |= need;
 }
 
 // Read data from inode.
 // Caller must hold ip->lock.
 // If user_dst==1, then dst is a user virtual address;
 // otherwise, dst is a kernel address.
+// A regular file's data is read through the page cache,
+// a page at a time; directories are read through the
+// buffer cache with the rest of the metadata.
 int
 readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  struct page *pg;
 
   if(off > ip->size || off + n < off)
     return 0;
@@ -464,7 +1211,22 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
     n = ip->size - off;
 
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    if(ip->type == T_FILE && (pg = pcget(ip, off/PGSIZE)) != 0){
+      if(pg->valid != PGVALID)
+        pfill(ip, pg, PGVALID);
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      if(either_copyout(user_dst, dst, pg->data + (off % PGSIZE), m) == -1) {
+        pcput(pg);
+        tot = -1;
+        break;
+      }
+      pcput(pg);
+      continue;
+    }
+    uint addr = bmap(ip, off/BSIZE);
+    if(addr == 0)
+      break;
+    bp = bread(ip->dev, addr);
     m = min(n - tot, BSIZE - off%BSIZE);
     if(either_copyout(user_dst, dst, bp->data + (off % BSIZE), m) == -1) {
       brelse(bp);
@@ -476,6 +1238,246 @@ readi(struct inode *ip, int user_dst, uint64 dst, uint off, uint n)
   return tot;
 }
 
+// Write to a regular file's pages in the page cache, and
+// mark the blocks written dirty, for iflush() to write back
+// later. Returns the number of bytes written, which is short
+// if the disk or memory is full.
+static int
+writepc(struct inode *ip, int user_src, uint64 src, uint off, uint n)
+{
+  uint tot, m, have, want, d, first, last;
+  struct page *pg;
+  uint mask, part, valid;
+  int promised;
+
+  // promise the disk blocks the write adds; if there aren't
+  // enough, write only into blocks the file already has.
+  d = ndelayed(ip);
+  have = (ip->size + BSIZE - 1) / BSIZE;
+  if(nalloc(ip) > have)
+    have = nalloc(ip);
+  want = (off + n + BSIZE - 1) / BSIZE;
+  promised = 0;
+  if(want > have){
+    if(breserve(want - have) == 0)
+      promised = want - have;
+    else if(off >= have*BSIZE)
+      return 0;
+    else
+      n = have*BSIZE - off;
+  }
+
+  for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+    if((pg = pcget(ip, off/PGSIZE)) == 0)
+      break;
+    m = min(n - tot, PGSIZE - off%PGSIZE);
+    first = off % PGSIZE / BSIZE;
+    last = (off % PGSIZE + m - 1) / BSIZE;
+    mask = ((1 << (last + 1)) - 1) & ~((1 << first) - 1);
+    // read in only the blocks the write covers in part;
+    // the rest of the page can wait until someone reads it.
+    part = 0;
+    if(off % BSIZE)
+      part |= 1 << first;
+    if((off + m) % BSIZE)
+      part |= 1 << last;
+    pfill(ip, pg, part);
+    valid = pg->valid;
+    if(either_copyin(pg->data + (off % PGSIZE), user_src, src, m) == -1) {
+      pg->valid = valid;
+      pcput(pg);
+      break;
+    }
+    pg->valid |= mask;
+    pcdirty(pg, mask);
+    pcput(pg);
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+  // give back what a short write didn't need.
+  bunreserve(promised - (ndelayed(ip) - d));
+
+  if(tot > 0 && !ip->dirty){
+    ip->dirty = 1;
+    idup(ip);
+    acquire(&idirty.lock);
+    ip->dnext = idirty.head;
+    idirty.head = ip;
+    release(&idirty.lock);
+  }
+  return tot;
+}
+
+// runs of blocks one iflush() transaction allocates: each
+// logs at most a bitmap block and two extent blocks.
+#define FLUSHRUNS ((MAXOPBLOCKS-1) / 3)
+
+// Write back some of ip's dirty pages, for iflush(). Caller
+// holds ip->lock, and is in a transaction. Returns 1 if there
+// is more to write back.
+static int
+iflush1(struct inode *ip)
+{
+  struct page *pgs[16];
+  uint d, want, lim, lim0, bn;
+  int i, j, n;
+
+  if(ip->type != T_FILE || !pcisdirty(ip))
+    return 0;
+
+  // give blocks to the data past nalloc(ip).
+  d = ndelayed(ip);
+  want = (ip->size + BSIZE - 1) / BSIZE;
+  lim = lim0 = nalloc(ip);
+  if(lim < want){
+    if(sb.features & FS_EXTENTS){
+      xgrow(ip, want, FLUSHRUNS);
+      lim = ip->nblocks;
+    } else {
+      for(i = 0; lim < want && i < FLUSHRUNS; lim++, i++)
+        if(bmap(ip, lim) == 0)
+          break;
+    }
+  }
+
+  // write the data to its blocks, in place.
+  do {
+    n = pcdirtypages(ip, lim, pgs, NELEM(pgs));
+    for(i = 0; i < n; i++){
+      for(j = 0; j < PGSIZE/BSIZE; j++){
+        bn = pgs[i]->pgno * (PGSIZE/BSIZE) + j;
+        if(bn < lim && (pgs[i]->dirty & (1 << j))){
+          bstore(ip->dev, bmap(ip, bn), pgs[i]->data + j*BSIZE);
+          pcclean(pgs[i], 1 << j);
+        }
+      }
+      pcput(pgs[i]);
+    }
+  } while(n == NELEM(pgs));
+
+  if(lim < want && lim == lim0){
+    // the disk filled up despite breserve(): drop the
+    // data that has no blocks.
+    printf("iflush: out of blocks\n");
+    while((n = pcdirtypages(ip, want, pgs, NELEM(pgs))) > 0){
+      for(i = 0; i < n; i++){
+        pcclean(pgs[i], ~0);
+        pcput(pgs[i]);
+      }
+    }
+    ip->size = lim*BSIZE;
+  }
+
+  // then log the blocks and the size that covers them.
+  ip->dsize = lim*BSIZE < ip->size ? lim*BSIZE : ip->size;
+  iupdate(ip);
+  bunreserve(d - ndelayed(ip));
+  return ndelayed(ip) > 0;
+}
+
+// Write ip's dirty pages back to the disk. a block past
+// nalloc(ip) gets a disk block only now, so the data a write
+// adds lands in runs as long as the write. the data goes to
+// its blocks directly, not through the log, before the
+// transaction that logs the blocks and the new size commits,
+// so after a crash a file never has blocks that weren't
+// written. each transaction allocates at most FLUSHRUNS runs,
+// to stay within MAXOPBLOCKS.
+//
+// blocks are written in place, so a crash can leave a mix of
+// old and new data in a file.
+//
+// Caller must hold a reference to ip, but not its lock, and
+// must not be in a transaction.
+void
+iflush(struct inode *ip)
+{
+  int more;
+
+  do {
+    begin_op();
+    ilock(ip);
+    more = iflush1(ip);
+    iunlock(ip);
+    end_op();
+  } while(more);
+}
+
+// Write back all the dirty file data, and let the inodes
+// that are clean again leave the table.
+void
+isync(void)
+{
+  struct inode *ip, *next;
+  int clean;
+
+  acquiresleep(&idirty.sync);
+  acquire(&idirty.lock);
+  ip = idirty.head;
+  idirty.head = 0;
+  release(&idirty.lock);
+  for(; ip; ip = next){
+    next = ip->dnext;
+    iflush(ip);
+    ilock(ip);
+    // a write may have dirtied more since.
+    if((clean = !pcisdirty(ip)) != 0){
+      ip->dirty = 0;
+    } else {
+      acquire(&idirty.lock);
+      ip->dnext = idirty.head;
+      idirty.head = ip;
+      release(&idirty.lock);
+    }
+    iunlock(ip);
+    if(clean){
+      begin_op();
+      iput(ip);
+      end_op();
+    }
+  }
+  acquire(&idirty.lock);
+  idirty.gen++;
+  wakeup(&idirty.gen);
+  release(&idirty.lock);
+  releasesleep(&idirty.sync);
+}
+
+// Too much of the page cache is dirty: have iflushd() write
+// it all back now, and wait until it has, rather than make
+// this writer pay for every file's data.
+void
+iflushwait(void)
+{
+  uint gen;
+
+  acquire(&idirty.lock);
+  gen = idirty.gen;
+  idirty.kick = 1;
+  while(idirty.gen == gen)
+    sleep(&idirty.gen, &idirty.lock);
+  release(&idirty.lock);
+}
+
+// The write-back thread: writes back all the dirty file
+// data every FLUSHTICKS, or within a tick of iflushwait().
+void
+iflushd(void)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < FLUSHTICKS && !idirty.kick)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    idirty.kick = 0;
+    isync();
+  }
+}
+
 // Write data to inode.
 // Caller must hold ip->lock.
 // If user_src==1, then src is a user virtual address;
@@ -491,12 +1493,23 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
 
   if(off > ip->size || off + n < off)
     return -1;
-  if(off + n > MAXFILE*BSIZE)
+  if(!(sb.features & FS_EXTENTS) && off + n > MAXFILE*BSIZE)
     return -1;
+  if(ip->type == T_FILE)
+    return writepc(ip, user_src, src, off, n);
 
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
-    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    uint addr = bmap(ip, off/BSIZE);
+    if(addr == 0)
+      break;
     m = min(n - tot, BSIZE - off%BSIZE);
+    // no need to read a block that is all overwritten, but
+    // only a kernel copy can't fail and leave bnew()'s zeroed
+    // block in the cache in place of the disk's.
+    if(m == BSIZE && !user_src)
+      bp = bnew(ip->dev, addr);
+    else
+      bp = bread(ip->dev, addr);
     if(either_copyin(bp->data + (off % BSIZE), user_src, src, m) == -1) {
       brelse(bp);
       break;
@@ -524,47 +1537,48 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
-// Look for a directory entry in a directory.
-// If found, set *poff to byte offset of entry.
-struct inode*
-dirlookup(struct inode *dp, char *name, uint *poff)
+// Length of path element name.
+static int
+namelen(char *name)
 {
-  uint off, inum;
-  struct dirent de;
+  int n;
 
-  if(dp->type != T_DIR)
-    panic("dirlookup not DIR");
+  for(n = 0; n < DIRSIZ && name[n]; n++)
+    ;
+  return n;
+}
+
+// Directories without FS_HASHDIR: a list of odirents,
+// searched from the start for each name. names are at
+// most ODIRSIZ bytes; skipelem() cuts them short.
+
+// Look for name in dp. If found, set *poff to the
+// byte offset of its entry and return its i-number.
+static uint
+linlookup(struct inode *dp, char *name, uint *poff)
+{
+  uint off;
+  struct odirent de;
 
   for(off = 0; off < dp->size; off += sizeof(de)){
     if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
       panic("dirlookup read");
     if(de.inum == 0)
       continue;
-    if(namecmp(name, de.name) == 0){
-      // entry matches path element
+    if(strncmp(name, de.name, ODIRSIZ) == 0){
       if(poff)
         *poff = off;
-      inum = de.inum;
-      return iget(dp->dev, inum);
+      return de.inum;
     }
   }
-
   return 0;
 }
 
-// Write a new directory entry (name, inum) into the directory dp.
-int
-dirlink(struct inode *dp, char *name, uint inum)
+static int
+linlink(struct inode *dp, char *name, uint inum)
 {
   int off;
-  struct dirent de;
-  struct inode *ip;
-
-  // Check that name is not present.
-  if((ip = dirlookup(dp, name, 0)) != 0){
-    iput(ip);
-    return -1;
-  }
+  struct odirent de;
 
   // Look for an empty dirent.
   for(off = 0; off < dp->size; off += sizeof(de)){
@@ -574,14 +1588,480 @@ dirlink(struct inode *dp, char *name, uint inum)
       break;
   }
 
-  strncpy(de.name, name, DIRSIZ);
+  strncpy(de.name, name, ODIRSIZ);
   de.inum = inum;
   if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
-    panic("dirlink");
+    return -1;
+  return 0;
+}
+
+static int
+linunlink(struct inode *dp, char *name)
+{
+  uint off;
+  struct odirent de;
+
+  if(linlookup(dp, name, &off) == 0)
+    return -1;
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+  return 0;
+}
+
+static int
+linempty(struct inode *dp)
+{
+  int off;
+  struct odirent de;
+
+  for(off=2*sizeof(de); off<dp->size; off+=sizeof(de)){
+    if(readi(dp, 0, (uint64)&de, off, sizeof(de)) != sizeof(de))
+      panic("isdirempty: readi");
+    if(de.inum != 0)
+      return 0;
+  }
+  return 1;
+}
+
+// *poff is the offset of the next odirent to read.
+static int
+linreaddir(struct inode *dp, int user_dst, uint64 dst, uint *poff, uint n)
+{
+  struct odirent od;
+  struct dirent de;
+  uint tot;
+
+  for(tot = 0; tot + sizeof(de) <= n && *poff + sizeof(od) <= dp->size; *poff += sizeof(od)){
+    if(readi(dp, 0, (uint64)&od, *poff, sizeof(od)) != sizeof(od))
+      return -1;
+    if(od.inum == 0)
+      continue;
+    memset(&de, 0, sizeof(de));
+    de.inum = od.inum;
+    memmove(de.name, od.name, ODIRSIZ);
+    if(either_copyout(user_dst, dst + tot, &de, sizeof(de)) == -1)
+      return -1;
+    tot += sizeof(de);
+  }
+  return tot;
+}
+
+// Hashed directories, with FS_HASHDIR. a lookup reads the
+// index and one leaf, however big the directory is. leaves
+// are split when they fill up but never merged, and the
+// index is a single block, which limits a directory to
+// NDXINDEX leaves: some thousands of names.
+
+// FNV-1a.
+static uint
+dxhash(char *name, int len)
+{
+  uint h = 2166136261U;
+  int i;
+
+  for(i = 0; i < len; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+// Read block bn of directory dp.
+static struct buf*
+dxbread(struct inode *dp, uint bn)
+{
+  uint addr;
+
+  if((addr = bmap(dp, bn)) == 0)
+    panic("dxbread");
+  return bread(dp->dev, addr);
+}
+
+// Index of the leaf in r for names with hash h.
+static int
+dxfind(struct dxroot *r, uint h)
+{
+  int lo, hi, mid;
+
+  if(r->magic != DXMAGIC)
+    panic("dxfind: magic");
+  lo = 0;
+  hi = r->nleaf - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(r->idx[mid].hash <= h)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return lo;
+}
+
+// Offset of name's record in leaf bp, or 0.
+static uint
+dxscan(struct buf *bp, char *name, int len)
+{
+  struct dxleaf *l = (struct dxleaf*)bp->data;
+  struct dxent *e;
+  uint off;
+
+  for(off = sizeof(*l); off < l->used; off += DXRECLEN(e->namelen)){
+    e = (struct dxent*)(bp->data + off);
+    if(e->namelen == len && memcmp(e->name, name, len) == 0)
+      return off;
+  }
+  return 0;
+}
+
+// Read the index of dp into *rbp and the leaf
+// for name into *bp. Returns the leaf's index slot.
+static int
+dxleafof(struct inode *dp, char *name, struct buf **rbp, struct buf **bp)
+{
+  struct dxroot *r;
+  int i;
+
+  *rbp = dxbread(dp, 0);
+  r = (struct dxroot*)(*rbp)->data;
+  i = dxfind(r, dxhash(name, namelen(name)));
+  *bp = dxbread(dp, r->idx[i].block);
+  return i;
+}
+
+static uint
+dxlookup(struct inode *dp, char *name)
+{
+  struct buf *rb, *bp;
+  uint off, inum;
 
+  if(dp->size == 0)
+    return 0;
+  dxleafof(dp, name, &rb, &bp);
+  brelse(rb);
+  inum = 0;
+  if((off = dxscan(bp, name, namelen(name))) != 0)
+    inum = ((struct dxent*)(bp->data + off))->inum;
+  brelse(bp);
+  return inum;
+}
+
+// Give the new directory dp an index with one empty leaf.
+static int
+dxinit(struct inode *dp)
+{
+  struct buf *bp;
+  struct dxroot *r;
+  struct dxleaf *l;
+  uint a0, a1;
+
+  if((a0 = bmap(dp, 0)) == 0 || (a1 = bmap(dp, 1)) == 0)
+    return -1;
+  bp = bread(dp->dev, a0);
+  memset(bp->data, 0, BSIZE);
+  r = (struct dxroot*)bp->data;
+  r->magic = DXMAGIC;
+  r->nleaf = 1;
+  r->idx[0].hash = 0;
+  r->idx[0].block = 1;
+  log_write(bp);
+  brelse(bp);
+  bp = bread(dp->dev, a1);
+  l = (struct dxleaf*)bp->data;
+  l->used = sizeof(*l);
+  l->n = 0;
+  log_write(bp);
+  brelse(bp);
+  dp->size = 2*BSIZE;
+  iupdate(dp);
   return 0;
 }
 
+// Split the full leaf bp, in slot i of index rb: the names
+// with the higher half of its hashes move to a new leaf.
+// equal hashes can't be split, so this fails if they all are.
+static int
+dxsplit(struct inode *dp, struct buf *rb, struct buf *bp, int i)
+{
+  struct dxroot *r = (struct dxroot*)rb->data;
+  struct dxleaf *l = (struct dxleaf*)bp->data, *nl;
+  struct dxent *e, *f;
+  struct buf *nbp;
+  uint off, off1, to, h, split, below, best, nb, reclen, addr;
+
+  if(r->nleaf >= NDXINDEX)
+    return -1;
+
+  // the split hash is the one nearest the median with
+  // something below it; a leaf has too few names for
+  // sorting them to be worth it.
+  split = 0;
+  best = 0;
+  for(off = sizeof(*l); off < l->used; off += DXRECLEN(e->namelen)){
+    e = (struct dxent*)(bp->data + off);
+    h = dxhash(e->name, e->namelen);
+    below = 0;
+    for(off1 = sizeof(*l); off1 < l->used; off1 += DXRECLEN(f->namelen)){
+      f = (struct dxent*)(bp->data + off1);
+      if(dxhash(f->name, f->namelen) < h)
+        below++;
+    }
+    if(below > 0 && min(below, l->n - below) > best){
+      best = min(below, l->n - below);
+      split = h;
+    }
+  }
+  if(best == 0)
+    return -1;
+
+  nb = dp->size / BSIZE;
+  if((addr = bmap(dp, nb)) == 0)
+    return -1;
+  nbp = bread(dp->dev, addr);
+  nl = (struct dxleaf*)nbp->data;
+  nl->used = sizeof(*nl);
+  nl->n = 0;
+  for(off = to = sizeof(*l); off < l->used; off += reclen){
+    e = (struct dxent*)(bp->data + off);
+    reclen = DXRECLEN(e->namelen);
+    if(dxhash(e->name, e->namelen) >= split){
+      memmove(nbp->data + nl->used, e, reclen);
+      nl->used += reclen;
+      nl->n++;
+    } else {
+      memmove(bp->data + to, e, reclen);
+      to += reclen;
+    }
+  }
+  l->used = to;
+  l->n -= nl->n;
+  log_write(bp);
+  log_write(nbp);
+  brelse(nbp);
+
+  memmove(&r->idx[i+2], &r->idx[i+1], (r->nleaf - i - 1) * sizeof(r->idx[0]));
+  r->idx[i+1].hash = split;
+  r->idx[i+1].block = nb;
+  r->nleaf++;
+  log_write(rb);
+  dp->size += BSIZE;
+  iupdate(dp);
+  return 0;
+}
+
+static int
+dxlink(struct inode *dp, char *name, uint inum)
+{
+  struct buf *rb, *bp;
+  struct dxleaf *l;
+  struct dxent *e;
+  int i, len;
+
+  if(dp->size == 0 && dxinit(dp) < 0)
+    return -1;
+  len = namelen(name);
+  i = dxleafof(dp, name, &rb, &bp);
+  l = (struct dxleaf*)bp->data;
+  if(l->used + DXRECLEN(len) > BSIZE){
+    if(dxsplit(dp, rb, bp, i) < 0)
+      goto bad;
+    brelse(bp);
+    brelse(rb);
+    dxleafof(dp, name, &rb, &bp);
+    l = (struct dxleaf*)bp->data;
+    if(l->used + DXRECLEN(len) > BSIZE)
+      goto bad;
+  }
+
+  e = (struct dxent*)(bp->data + l->used);
+  e->inum = inum;
+  e->namelen = len;
+  memmove(e->name, name, len);
+  l->used += DXRECLEN(len);
+  l->n++;
+  log_write(bp);
+  ((struct dxroot*)rb->data)->nentries++;
+  log_write(rb);
+  brelse(bp);
+  brelse(rb);
+  return 0;
+
+bad:
+  brelse(bp);
+  brelse(rb);
+  return -1;
+}
+
+static int
+dxunlink(struct inode *dp, char *name)
+{
+  struct buf *rb, *bp;
+  struct dxleaf *l;
+  uint off, reclen;
+
+  dxleafof(dp, name, &rb, &bp);
+  if((off = dxscan(bp, name, namelen(name))) == 0){
+    brelse(bp);
+    brelse(rb);
+    return -1;
+  }
+  l = (struct dxleaf*)bp->data;
+  reclen = DXRECLEN(((struct dxent*)(bp->data + off))->namelen);
+  memmove(bp->data + off, bp->data + off + reclen, l->used - off - reclen);
+  l->used -= reclen;
+  l->n--;
+  log_write(bp);
+  ((struct dxroot*)rb->data)->nentries--;
+  log_write(rb);
+  brelse(bp);
+  brelse(rb);
+  return 0;
+}
+
+static int
+dxempty(struct inode *dp)
+{
+  struct buf *rb;
+  int n;
+
+  rb = dxbread(dp, 0);
+  n = ((struct dxroot*)rb->data)->nentries;
+  brelse(rb);
+  return n <= 2;
+}
+
+// *poff is the leaf's block number in the upper 16 bits,
+// and the number of its records already read in the lower.
+// unlinking a name while the directory is being read may
+// shift a record that has not been read past the count.
+static int
+dxreaddir(struct inode *dp, int user_dst, uint64 dst, uint *poff, uint n)
+{
+  struct buf *bp;
+  struct dxleaf *l;
+  struct dxent *e;
+  struct dirent de;
+  uint b, i, k, off, tot;
+  int more;
+
+  b = *poff >> 16;
+  k = *poff & 0xffff;
+  if(b == 0)
+    b = 1;
+  tot = 0;
+  while(tot + sizeof(de) <= n && b < dp->size / BSIZE){
+    bp = dxbread(dp, b);
+    l = (struct dxleaf*)bp->data;
+    i = 0;
+    for(off = sizeof(*l); off < l->used; off += DXRECLEN(e->namelen), i++){
+      e = (struct dxent*)(bp->data + off);
+      if(i < k)
+        continue;
+      if(tot + sizeof(de) > n)
+        break;
+      memset(&de, 0, sizeof(de));
+      de.inum = e->inum;
+      memmove(de.name, e->name, e->namelen);
+      if(either_copyout(user_dst, dst + tot, &de, sizeof(de)) == -1){
+        brelse(bp);
+        return -1;
+      }
+      tot += sizeof(de);
+      k++;
+    }
+    more = off < l->used;
+    brelse(bp);
+    if(more)
+      break;
+    b++;
+    k = 0;
+  }
+  *poff = b << 16 | k;
+  return tot;
+}
+
+// Look for a directory entry in a directory.
+struct inode*
+dirlookup(struct inode *dp, char *name)
+{
+  uint inum;
+  struct inode *ip;
+
+  if(dp->type != T_DIR)
+    panic("dirlookup not DIR");
+
+  if(dcachelookup(dp, name, &ip))
+    return ip;
+
+  if(sb.features & FS_HASHDIR)
+    inum = dxlookup(dp, name);
+  else
+    inum = linlookup(dp, name, 0);
+  dcacheenter(dp, name, inum);
+  if(inum == 0)
+    return 0;
+  return iget(dp->dev, inum);
+}
+
+// Write a new directory entry (name, inum) into the directory dp.
+// Returns -1 if name is present, or there's no room for it.
+int
+dirlink(struct inode *dp, char *name, uint inum)
+{
+  struct inode *ip;
+  int r;
+
+  // Check that name is not present.
+  if((ip = dirlookup(dp, name)) != 0){
+    iput(ip);
+    return -1;
+  }
+
+  if(sb.features & FS_HASHDIR)
+    r = dxlink(dp, name, inum);
+  else
+    r = linlink(dp, name, inum);
+  if(r < 0)
+    return -1;
+  dcacheenter(dp, name, inum);
+  return 0;
+}
+
+// Remove name's entry from the directory dp.
+int
+dirunlink(struct inode *dp, char *name)
+{
+  int r;
+
+  if(sb.features & FS_HASHDIR)
+    r = dxunlink(dp, name);
+  else
+    r = linunlink(dp, name);
+  dcacheenter(dp, name, 0);
+  return r;
+}
+
+// Is the directory dp empty except for "." and ".." ?
+int
+dirempty(struct inode *dp)
+{
+  if(sb.features & FS_HASHDIR)
+    return dxempty(dp);
+  return linempty(dp);
+}
+
+// Read the entries of directory dp as dirents, starting at
+// the opaque position *poff, which a read of 0 starts at.
+// Returns the number of bytes read, a multiple of
+// sizeof(struct dirent), and advances *poff.
+int
+dirread(struct inode *dp, int user_dst, uint64 dst, uint *poff, uint n)
+{
+  if(sb.features & FS_HASHDIR)
+    return dxreaddir(dp, user_dst, dst, poff, n);
+  return linreaddir(dp, user_dst, dst, poff, n);
+}
+
 // Paths
 
 // Copy the next path element from path into name.
@@ -600,7 +2080,7 @@ static char*
 skipelem(char *path, char *name)
 {
   char *s;
-  int len;
+  int len, max;
 
   while(*path == '/')
     path++;
@@ -610,9 +2090,12 @@ skipelem(char *path, char *name)
   while(*path != '/' && *path != 0)
     path++;
   len = path - s;
-  if(len >= DIRSIZ)
-    memmove(name, s, DIRSIZ);
-  else {
+  max = (sb.features & FS_HASHDIR) ? DIRSIZ : ODIRSIZ;
+  if(len >= max){
+    memmove(name, s, max);
+    if(max < DIRSIZ)
+      name[max] = 0;
+  } else {
     memmove(name, s, len);
     name[len] = 0;
   }
@@ -633,9 +2116,18 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(myproc()->cwd);
+    ip = cwdget();
 
   while((path = skipelem(path, name)) != 0){
+    // the dentry cache only knows names in directories,
+    // so a hit needs no lock on ip to check its type.
+    if((!nameiparent || *path != '\0') && dcachelookup(ip, name, &next)){
+      iput(ip);
+      if(next == 0)
+        return 0;
+      ip = next;
+      continue;
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -646,7 +2138,7 @@ namex(char *path, int nameiparent, char *name)
       iunlock(ip);
       return ip;
     }
-    if((next = dirlookup(ip, name, 0)) == 0){
+    if((next = dirlookup(ip, name)) == 0){
       iunlockput(ip);
       return 0;
     }
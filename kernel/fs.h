@@ -3,14 +3,26 @@
 
 
 #define ROOTINO  1   // root i-number
-#define BSIZE 1024  // block size
+
+// mkfs makes blocks of 1024, 2048 or 4096 bytes, and records
+// the size in the super block. BSIZE is the size of the file
+// system in use, which the kernel and mkfs keep in fsbsize.
+// structures laid over a block are declared for the largest
+// size, and use only the first BSIZE bytes.
+#define MINBSIZE 1024
+#define MAXBSIZE 4096
+#define BSIZE    fsbsize
+extern uint fsbsize;
 
 // Disk layout:
 // [ boot block | super block | log | inode blocks |
 //                                          free bit map | data blocks]
 //
 // mkfs computes the super block and builds an initial file system. The
-// super block describes the disk layout:
+// super block describes the disk layout. it is at byte MINBSIZE
+// whatever the block size, so that it can be read before the size
+// is known: in block 1 with the smallest blocks, and inside the
+// boot block with larger ones, which then has no block of its own.
 struct superblock {
   uint magic;        // Must be FSMAGIC
   uint size;         // Size of file system image (blocks)
@@ -20,14 +32,46 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint features;     // FS_ flags; 0 in images from older mkfs
+  uint bsize;        // Block size; 0 in images from older mkfs, for MINBSIZE
 };
 
+// Block number of the first block after the super block.
+#define SBEND(bsize)  ((2*MINBSIZE + (bsize) - 1) / (bsize))
+
 #define FSMAGIC 0x10203040
 
+// superblock features.
+#define FS_EXTENTS 0x1  // inodes map their blocks with extents
+#define FS_HASHDIR 0x2  // new directories are hashed; see below
+
+// without FS_EXTENTS, an inode lists its first NDIRECT blocks,
+// and then the block holding the numbers of the next NINDIRECT.
 #define NDIRECT 12
 #define NINDIRECT (BSIZE / sizeof(uint))
 #define MAXFILE (NDIRECT + NINDIRECT)
 
+// with FS_EXTENTS, an inode's blocks are runs of consecutive
+// blocks: the first NEXTENT runs in the inode, and any more
+// in a chain of extent blocks. files have no holes, so each
+// run starts where the one before it ends in the file.
+#define NEXTENT 5
+
+struct extent {
+  uint start;           // First block of the run
+  uint len;             // Number of blocks
+};
+
+#define NXEXTENTS(bsize) (((bsize) - 2*sizeof(uint)) / sizeof(struct extent))
+#define NXEXTENT NXEXTENTS(BSIZE)
+
+// an extent block.
+struct xblock {
+  uint next;            // Next extent block, or 0
+  uint n;               // Extents used in ext[]
+  struct extent ext[NXEXTENTS(MAXBSIZE)];
+};
+
 // On-disk inode structure
 struct dinode {
   short type;           // File type
@@ -35,7 +79,15 @@ struct dinode {
   short minor;          // Minor device number (T_DEVICE only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  union {
+    uint addrs[NDIRECT+1];   // Data block addresses
+    struct {
+      struct extent ext[NEXTENT]; // First runs of data blocks, with FS_EXTENTS
+      uint nblocks;         // Blocks in all the runs
+      uint xhead;           // First extent block, or 0
+      uint xtail;           // Last extent block, or 0
+    };
+  };
 };
 
 // Inodes per block.
@@ -50,11 +102,57 @@ struct dinode {
 // Block of free map containing bit for block b
 #define BBLOCK(b, sb) ((b)/BPB + sb.bmapstart)
 
-// Directory is a file containing a sequence of dirent structures.
-#define DIRSIZ 14
+// Longest file name. directory reads return a sequence of
+// dirent structures, whatever the directory's format.
+#define DIRSIZ 62
 
 struct dirent {
   ushort inum;
   char name[DIRSIZ];
 };
 
+// without FS_HASHDIR, a directory is a file containing a
+// sequence of odirent structures, with names of at most
+// ODIRSIZ bytes. longer names are cut short.
+#define ODIRSIZ 14
+
+struct odirent {
+  ushort inum;
+  char name[ODIRSIZ];
+};
+
+// with FS_HASHDIR, block 0 of a directory is an index of its
+// leaf blocks, sorted by the hash of the names in them: leaf
+// idx[i].block holds names whose hash is at least idx[i].hash
+// and less than idx[i+1].hash. a leaf holds dxent records, each
+// rounded up to 4 bytes, one after the other from offset
+// sizeof(struct dxleaf) to used; a full leaf is split in two.
+#define DXMAGIC 0x64786972
+
+struct dxindex {
+  uint hash;            // Least hash in the leaf
+  uint block;           // Leaf's block number in the directory
+};
+
+#define NDXINDEXS(bsize) (((bsize) - 3*sizeof(uint)) / sizeof(struct dxindex))
+#define NDXINDEX NDXINDEXS(BSIZE)
+
+struct dxroot {
+  uint magic;           // Must be DXMAGIC
+  uint nentries;        // Names in the directory, with . and ..
+  uint nleaf;           // Leaves in idx[]
+  struct dxindex idx[NDXINDEXS(MAXBSIZE)];
+};
+
+struct dxleaf {
+  ushort used;          // Bytes in use, with this header
+  ushort n;             // Number of records
+};
+
+struct dxent {
+  uint inum;
+  uchar namelen;
+  char name[];          // Not NUL-terminated
+};
+
+#define DXRECLEN(namelen) ((sizeof(struct dxent) + (namelen) + 3) & ~3)
@@ -0,0 +1,136 @@
+//
+// Kernel event trace. See ktrace.h.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "ktrace.h"
+#include "defs.h"
+
+// events each CPU holds until read.
+#define NKTEVENT 1024
+
+// a CPU's events. only that CPU adds them, with interrupts
+// off, and only ktread() removes them, so it takes no lock:
+// acquire() itself records events.
+struct ktbuf {
+  struct ktevent e[NKTEVENT];
+  uint head;      // next to read; only ktread() advances it
+  uint tail;      // next to write; only this CPU advances it
+  uint dropped;   // events lost since ktread() last looked
+};
+
+static struct ktbuf ktbufs[NCPU];
+static int ktracemask;
+
+// serializes ktread()s.
+static struct spinlock ktread_lock;
+
+void
+ktraceinit(void)
+{
+  initlock(&ktread_lock, "ktread");
+}
+
+// Record an event of type, if category cat is on.
+// name may be 0.
+void
+ktrace(int cat, int type, int pid, uint64 arg0, uint64 arg1, char *name)
+{
+  struct ktbuf *b;
+  struct ktevent *e;
+
+  if((__atomic_load_n(&ktracemask, __ATOMIC_RELAXED) & cat) == 0)
+    return;
+  push_off();
+  b = &ktbufs[cpuid()];
+  if(b->tail - __atomic_load_n(&b->head, __ATOMIC_ACQUIRE) == NKTEVENT){
+    __sync_fetch_and_add(&b->dropped, 1);
+  } else {
+    e = &b->e[b->tail % NKTEVENT];
+    e->time = r_time();
+    e->type = type;
+    e->cpu = cpuid();
+    e->pid = pid;
+    e->arg0 = arg0;
+    e->arg1 = arg1;
+    if(name)
+      safestrcpy(e->name, name, sizeof(e->name));
+    else
+      e->name[0] = 0;
+    // the event must be complete before ktread() sees it.
+    __sync_synchronize();
+    b->tail++;
+  }
+  pop_off();
+}
+
+// Move up to n events to user address addr, reporting
+// dropped events as KE_LOST. Returns the number moved,
+// or -1 if addr is bad.
+static int
+ktread(uint64 addr, int n)
+{
+  struct ktbuf *b;
+  struct ktevent e;
+  uint lost;
+  int i = 0;
+
+  acquire(&ktread_lock);
+  for(b = ktbufs; b < &ktbufs[NCPU] && i < n; b++){
+    if((lost = __sync_lock_test_and_set(&b->dropped, 0)) != 0){
+      memset(&e, 0, sizeof(e));
+      e.time = r_time();
+      e.type = KE_LOST;
+      e.cpu = b - ktbufs;
+      e.arg0 = lost;
+      if(copyout(myproc()->pagetable, addr + i*sizeof(e), (char *)&e, sizeof(e)) < 0)
+        goto bad;
+      i++;
+    }
+    while(i < n && b->head != __atomic_load_n(&b->tail, __ATOMIC_ACQUIRE)){
+      e = b->e[b->head % NKTEVENT];
+      // done with the slot; the CPU may reuse it.
+      __sync_synchronize();
+      b->head++;
+      if(copyout(myproc()->pagetable, addr + i*sizeof(e), (char *)&e, sizeof(e)) < 0)
+        goto bad;
+      i++;
+    }
+  }
+  release(&ktread_lock);
+  return i;
+
+bad:
+  release(&ktread_lock);
+  return -1;
+}
+
+// Turn on the event categories in mask, and the rest off,
+// unless mask is negative. Returns the mask before.
+uint64
+sys_ktrace(void)
+{
+  int mask;
+
+  if(argint(0, &mask) < 0)
+    return -1;
+  if(mask < 0)
+    return ktracemask;
+  return __atomic_exchange_n(&ktracemask, mask, __ATOMIC_RELAXED);
+}
+
+uint64
+sys_ktread(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return ktread(addr, n);
+}
@@ -0,0 +1,38 @@
+// Kernel event trace. Both the kernel and user programs
+// use this header file.
+//
+// ktrace(mask) turns on the categories of events in mask.
+// each CPU records its own events in its own buffer, and
+// ktread() removes them, oldest first for each CPU. times
+// are from the time CSR.
+
+// categories, for ktrace().
+#define KT_SCHED  0x1   // context switches
+#define KT_SLEEP  0x2   // sleep() and wakeups
+#define KT_BIO    0x4   // buffer cache hits and misses
+#define KT_DISK   0x8   // disk requests
+#define KT_FAULT  0x10  // faults in user space
+#define KT_LOCK   0x20  // contended spinlocks
+
+// event types.
+#define KE_SWITCHIN   1  // scheduler() runs pid
+#define KE_SWITCHOUT  2  // pid gives the CPU back to scheduler()
+#define KE_SLEEP      3  // pid sleeps on chan arg0
+#define KE_WAKEUP     4  // pid is woken from chan arg0
+#define KE_BHIT       5  // bread() found dev arg0 block arg1 cached
+#define KE_BMISS      6  // bread() must read dev arg0 block arg1
+#define KE_DISKSUBMIT 7  // disk request for block arg0, a write if arg1
+#define KE_DISKDONE   8  // disk finished with block arg0
+#define KE_FAULT      9  // pid faulted: scause arg0, stval arg1
+#define KE_LOCK      10  // spun arg1 ticks for lock name
+#define KE_LOST      11  // this CPU dropped arg0 events, buffer full
+
+struct ktevent {
+  uint64 time;    // time CSR
+  ushort type;    // KE_*
+  ushort cpu;     // CPU the event happened on
+  int pid;        // process the event is about, or 0
+  uint64 arg0;
+  uint64 arg1;
+  char name[16];  // process or lock name
+};
@@ -0,0 +1,10 @@
+// spinlock statistics, reported by lockstat(). they are
+// kept per lock name, summed over all locks with that name.
+#define LOCKNAME 16
+
+struct lockstat {
+  char name[LOCKNAME];  // name given to initlock()
+  uint64 nacquire;      // number of acquire()s
+  uint64 ncontended;    // acquire()s that had to wait
+  uint64 spin;          // time CSR ticks spent waiting
+};
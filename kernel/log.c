@@ -72,7 +72,7 @@ install_trans(int recovering)
 
   for (tail = 0; tail < log.lh.n; tail++) {
     struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
+    struct buf *dbuf = bnew(log.dev, log.lh.block[tail]); // dst, not read
     memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
     bwrite(dbuf);  // write dst to disk
     if(recovering == 0)
@@ -193,6 +193,7 @@ write_log(void)
 static void
 commit()
 {
+  bcommit();       // Let blocks the transaction freed be reused
   if (log.lh.n > 0) {
     write_log();     // Write modified blocks from cache to log
     write_head();    // Write header to disk -- the real commit
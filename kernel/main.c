@@ -20,12 +20,17 @@ main()
     kvminit();       // create kernel page table
     kvminithart();   // turn on paging
     procinit();      // process table
+    schedinit();     // run queues
     trapinit();      // trap vectors
+    profinit();      // profiler sample buffers
+    ktraceinit();    // event trace
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
     binit();         // buffer cache
+    pcinit();        // page cache
     iinit();         // inode table
+    dcacheinit();    // directory entry cache
     fileinit();      // file table
     virtio_disk_init(); // emulated hard disk
     userinit();      // first user process
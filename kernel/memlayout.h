@@ -29,6 +29,8 @@
 #define CLINT 0x2000000L
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
+#define CLINT_FREQ 10000000L // mtime (and the time CSR) ticks per second.
+#define CLINT_INTERVAL 1000000L // mtime ticks per timer interrupt; 1/10th second.
 
 // qemu puts platform-level interrupt controller (PLIC) here.
 #define PLIC 0x0c000000L
@@ -53,7 +55,9 @@
 
 // map kernel stacks beneath the trampoline,
 // each surrounded by invalid guard pages.
+// a proc's slot is the page number of its struct proc in RAM.
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
+#define NKSTACK ((PHYSTOP - KERNBASE) / PGSIZE)
 
 // User memory layout.
 // Address zero first:
@@ -62,6 +66,28 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   trapframes of threads made by clone(), one page per slot
+//   URING (vm->ring, batched system calls; only after ringsetup())
+//   USYSCALL (vm->usyscall, read-only data shared with the kernel)
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
+#define USYSCALL (TRAPFRAME - PGSIZE)
+#define URING (USYSCALL - PGSIZE)
+
+// threads sharing a page table each need their own trapframe.
+// slot 0, the first process in the address space, uses TRAPFRAME;
+// slots 1..NTHREAD-1 sit below URING.
+#define TRAPFRAMESLOT(i) ((i) == 0 ? TRAPFRAME : URING - (i)*PGSIZE)
+
+// data the kernel exports to user space at USYSCALL, so
+// that ugetpid() &c in ulib.c can read it without a trap.
+// the kernel starts each thread with tp pointing at its own
+// pid[] entry, USYSCALLPID(slot); ugetpid() checks tp before
+// trusting it, since user code may have reused the register.
+struct usyscall {
+  int pid[NTHREAD];   // Process ID of the thread in each slot
+  uint64 clockfreq;   // time CSR ticks per second
+  uint64 tickcycles;  // time CSR ticks per clock tick (see uptime())
+};
+#define USYSCALLPID(i) (USYSCALL + (i)*sizeof(int))
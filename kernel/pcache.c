@@ -0,0 +1,372 @@
+// Page cache.
+//
+// Holds the data of regular files a page at a time, indexed
+// by inode and file offset, so that the buffer cache holds
+// only metadata. readi() copies out of it, and writei()
+// copies into it and marks the blocks it wrote dirty;
+// iflush() writes them back later.
+//
+// A page's contents are protected by its inode's sleep-lock;
+// pcache.lock protects the hash table, the lists, refcnt and
+// dirty. readi() and iflush() hold a reference while they use
+// a page, which keeps pshrink() from taking it away.
+//
+// Like the buffer cache, the page cache grows while memory is
+// plentiful, recycles its least recently used pages once it
+// isn't, and gives pages back to kalloc() when it runs out.
+// dirty pages stay until they have been written back.
+
+#include "types.h"
+#include "param.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "riscv.h"
+#include "defs.h"
+#include "fs.h"
+#include "file.h"
+#include "pcache.h"
+#include "bcstat.h"
+
+#define NPHASH 1021
+#define HPERPAGE (PGSIZE / sizeof(struct page)) // headers in a page
+
+struct {
+  struct spinlock lock;
+  struct page *hash[NPHASH];
+  struct page *spare;   // headers without data, through hnext
+  int nspare;
+  uint64 reserve;       // add pages only while more are free
+  uint64 hits;
+  uint64 misses;
+  uint64 npage;
+  uint64 ndirty;        // pages with dirty blocks
+  uint64 dirtymax;      // write back before there are more
+  uint64 writes;        // blocks written back
+
+  // all pages with data, through prev/next.
+  // head.next is the most recently used, head.prev the least.
+  struct page head;
+} pcache;
+
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  pcache.head.prev = &pcache.head;
+  pcache.head.next = &pcache.head;
+  // leave an eighth of memory to everything else.
+  pcache.reserve = kfreepages() / 8;
+  pcache.dirtymax = kfreepages() / 16;
+}
+
+static struct page**
+phash(struct inode *ip, uint pgno)
+{
+  return &pcache.hash[((uint64)ip / sizeof(*ip) * 31 + pgno) % NPHASH];
+}
+
+// Remove pg from the hash table and its inode's list.
+// Caller holds pcache.lock.
+static void
+unhash(struct page *pg)
+{
+  struct page **pp;
+
+  if(pg->ip == 0)
+    return;
+  for(pp = phash(pg->ip, pg->pgno); *pp != pg; pp = &(*pp)->hnext)
+    ;
+  *pp = pg->hnext;
+  for(pp = &pg->ip->pages; *pp != pg; pp = &(*pp)->inext)
+    ;
+  *pp = pg->inext;
+  pg->ip = 0;
+}
+
+// Move pg to the front of the LRU list.
+static void
+touch(struct page *pg)
+{
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+  pg->next = pcache.head.next;
+  pg->prev = &pcache.head;
+  pcache.head.next->prev = pg;
+  pcache.head.next = pg;
+}
+
+// Free the page holding header h, if all its headers are
+// spare. Caller holds pcache.lock.
+static void
+freehdrs(struct page *h)
+{
+  struct page *page, **pp;
+  int n;
+
+  page = (struct page*)PGROUNDDOWN((uint64)h);
+  n = 0;
+  for(h = pcache.spare; h; h = h->hnext)
+    if(PGROUNDDOWN((uint64)h) == (uint64)page)
+      n++;
+  if(n < HPERPAGE)
+    return;
+  for(pp = &pcache.spare; *pp; ){
+    if(PGROUNDDOWN((uint64)*pp) == (uint64)page)
+      *pp = (*pp)->hnext;
+    else
+      pp = &(*pp)->hnext;
+  }
+  pcache.nspare -= HPERPAGE;
+  kfree(page);
+}
+
+// Take pg out of the cache and free its data.
+// Caller holds pcache.lock.
+static void
+pfree(struct page *pg)
+{
+  if(pg->dirty)
+    pcache.ndirty--;
+  pg->dirty = 0;
+  unhash(pg);
+  pg->next->prev = pg->prev;
+  pg->prev->next = pg->next;
+  kfree(pg->data);
+  pg->data = 0;
+  pg->hnext = pcache.spare;
+  pcache.spare = pg;
+  pcache.nspare++;
+  pcache.npage--;
+  freehdrs(pg);
+}
+
+// Add a page, least recently used. Returns 0 if out of memory.
+static int
+pgrow(void)
+{
+  struct page *pg;
+  char *data, *hdrs;
+  int i;
+
+  if((data = kalloc()) == 0)
+    return 0;
+  acquire(&pcache.lock);
+  if(pcache.nspare == 0){
+    release(&pcache.lock);
+    if((hdrs = kalloc()) == 0){
+      kfree(data);
+      return 0;
+    }
+    memset(hdrs, 0, PGSIZE);
+    acquire(&pcache.lock);
+    pg = (struct page*)hdrs;
+    for(i = 0; i < HPERPAGE; i++, pg++){
+      pg->hnext = pcache.spare;
+      pcache.spare = pg;
+      pcache.nspare++;
+    }
+  }
+  pg = pcache.spare;
+  pcache.spare = pg->hnext;
+  pcache.nspare--;
+  pg->data = (uchar*)data;
+  pg->ip = 0;
+  pg->refcnt = 0;
+  pg->prev = pcache.head.prev;
+  pg->next = &pcache.head;
+  pcache.head.prev->next = pg;
+  pcache.head.prev = pg;
+  pcache.npage++;
+  release(&pcache.lock);
+  return 1;
+}
+
+// Return the page of ip at file offset pgno*PGSIZE, with a
+// reference to it. The caller must fill in the blocks it needs
+// that aren't in pg->valid before unlocking ip. Returns 0 if
+// out of memory.
+// Caller must hold ip->lock.
+struct page*
+pcget(struct inode *ip, uint pgno)
+{
+  struct page *pg, **pp;
+  int grown = 0;
+
+  acquire(&pcache.lock);
+
+again:
+  for(pg = *phash(ip, pgno); pg; pg = pg->hnext){
+    if(pg->ip == ip && pg->pgno == pgno){
+      pg->refcnt++;
+      pcache.hits++;
+      touch(pg);
+      release(&pcache.lock);
+      return pg;
+    }
+  }
+
+  // recycle the least recently used clean, unreferenced
+  // page, unless there's memory to spare for another.
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev)
+    if(pg->refcnt == 0 && pg->dirty == 0)
+      break;
+  if((pg == &pcache.head || pg->ip) && !grown &&
+     (pg == &pcache.head || kfreepages() > pcache.reserve)){
+    // kalloc() may call pshrink(), so let go of the lock.
+    release(&pcache.lock);
+    pgrow();
+    acquire(&pcache.lock);
+    grown = 1;
+    goto again;
+  }
+  if(pg == &pcache.head){
+    release(&pcache.lock);
+    return 0;
+  }
+
+  pcache.misses++;
+  unhash(pg);
+  pg->ip = ip;
+  pg->pgno = pgno;
+  pg->valid = 0;
+  pg->refcnt = 1;
+  pp = phash(ip, pgno);
+  pg->hnext = *pp;
+  *pp = pg;
+  pg->inext = ip->pages;
+  ip->pages = pg;
+  touch(pg);
+  release(&pcache.lock);
+  return pg;
+}
+
+// Drop a reference to pg.
+void
+pcput(struct page *pg)
+{
+  acquire(&pcache.lock);
+  pg->refcnt--;
+  release(&pcache.lock);
+}
+
+// Mark the blocks in mask, bit i for block i of the page,
+// dirty. Caller must hold pg->ip->lock.
+void
+pcdirty(struct page *pg, uint mask)
+{
+  acquire(&pcache.lock);
+  if(pg->dirty == 0)
+    pcache.ndirty++;
+  pg->dirty |= mask;
+  release(&pcache.lock);
+}
+
+// Mark the blocks in mask clean again, now that they
+// have been written back.
+void
+pcclean(struct page *pg, uint mask)
+{
+  int i;
+
+  acquire(&pcache.lock);
+  for(i = 0; i < PGSIZE / BSIZE; i++)
+    if(pg->dirty & mask & (1 << i))
+      pcache.writes++;
+  if(pg->dirty && (pg->dirty &= ~mask) == 0)
+    pcache.ndirty--;
+  release(&pcache.lock);
+}
+
+// Find up to n of ip's pages with dirty blocks before block
+// lim, and put them in pgs with a reference to each. Returns
+// how many. Caller must hold ip->lock.
+int
+pcdirtypages(struct inode *ip, uint lim, struct page **pgs, int n)
+{
+  struct page *pg;
+  uint first, mask;
+  int i;
+
+  acquire(&pcache.lock);
+  i = 0;
+  for(pg = ip->pages; pg && i < n; pg = pg->inext){
+    first = pg->pgno * (PGSIZE / BSIZE);
+    if(first >= lim)
+      continue;
+    mask = lim - first >= PGSIZE / BSIZE ? ~0 : (1 << (lim - first)) - 1;
+    if(pg->dirty & mask){
+      pg->refcnt++;
+      pgs[i++] = pg;
+    }
+  }
+  release(&pcache.lock);
+  return i;
+}
+
+// Does ip have dirty pages? Caller must hold ip->lock.
+int
+pcisdirty(struct inode *ip)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = ip->pages; pg; pg = pg->inext)
+    if(pg->dirty)
+      break;
+  release(&pcache.lock);
+  return pg != 0;
+}
+
+// Should writers wait for dirty pages to be written back?
+int
+pctoodirty(void)
+{
+  return pcache.ndirty > pcache.dirtymax;
+}
+
+// Forget ip's pages, because its data is going away, or
+// ip is being recycled for another inode. Nothing may hold
+// references to them. dirty blocks are dropped.
+void
+pcpurge(struct inode *ip)
+{
+  acquire(&pcache.lock);
+  while(ip->pages){
+    if(ip->pages->refcnt)
+      panic("pcpurge");
+    pfree(ip->pages);
+  }
+  release(&pcache.lock);
+}
+
+// Give the least recently used unreferenced page back to
+// kalloc(), which is out of memory. Returns 1 if there was one.
+int
+pshrink(void)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  for(pg = pcache.head.prev; pg != &pcache.head; pg = pg->prev)
+    if(pg->refcnt == 0 && pg->dirty == 0)
+      break;
+  if(pg == &pcache.head){
+    release(&pcache.lock);
+    return 0;
+  }
+  pfree(pg);
+  release(&pcache.lock);
+  return 1;
+}
+
+void
+pcstat(struct bcstat *st)
+{
+  acquire(&pcache.lock);
+  st->phits = pcache.hits;
+  st->pmisses = pcache.misses;
+  st->npage = pcache.npage;
+  st->ndirty = pcache.ndirty;
+  st->pwrites = pcache.writes;
+  release(&pcache.lock);
+}
@@ -0,0 +1,16 @@
+// valid mask of a page with all its blocks filled in.
+#define PGVALID ((1 << (PGSIZE/BSIZE)) - 1)
+
+// a page of a file's data in the page cache.
+struct page {
+  struct inode *ip;    // file the page belongs to
+  uint pgno;           // file offset / PGSIZE
+  uint valid;          // bit i: block i holds the file's data
+  uint dirty;          // bit i: block i written, not yet written back
+  int refcnt;
+  struct page *hnext;  // hash chain, or spare list
+  struct page *inext;  // ip's pages
+  struct page *prev;   // LRU list
+  struct page *next;
+  uchar *data;         // PGSIZE bytes
+};
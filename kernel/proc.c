@@ -4,56 +4,95 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "sched.h"
+#include "ktrace.h"
+#include "rusage.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
-
 struct proc *initproc;
 
+// procs are kalloc()ed as needed; find them by pid with pidhash.
+// pid_lock guards nextpid and the hash chains, and must be
+// held from a lookup until done with the proc it found,
+// since freeproc() frees a proc once it is off the chain.
+#define NPIDHASH 61
+struct proc *pidhash[NPIDHASH];
 int nextpid = 1;
 struct spinlock pid_lock;
 
+// procs sleeping on a chan, hashed by chan, so that
+// wakeup() looks only at procs that might be on it.
+#define NSLEEPQ 61
+struct sleepq {
+  struct spinlock lock;
+  struct proc *head;
+} sleepqs[NSLEEPQ];
+
+static struct sleepq*
+sleepq(void *chan)
+{
+  return &sleepqs[(uint64)chan % NSLEEPQ];
+}
+
+extern pagetable_t kernel_pagetable; // vm.c
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static pagetable_t proc_pagetable(struct vmspace *vm, struct trapframe *tf);
+static void proc_freepagetable(struct vmspace *vm);
 
 extern char trampoline[]; // trampoline.S
 
-// helps ensure that wakeups of wait()ing
-// parents are not lost. helps obey the
-// memory model when using p->parent.
-// must be acquired before any p->lock.
-struct spinlock wait_lock;
+// each proc's waitlock guards its lists of children and
+// their parent pointers. it helps ensure that wakeups of
+// wait()ing parents are not lost. a proc's waitlock must be
+// acquired before initproc's, and before any p->lock, except
+// by lockparent(), which only tries for it.
+
+// serializes futex waits against wakes; see futexwait().
+struct spinlock futex_lock;
+
+// Allocate a page for p's kernel stack. Map it high in
+// memory, followed by an invalid guard page, at a slot
+// chosen by where p itself sits in physical memory, so
+// no two live procs share one. kvmmake() made the
+// page-table pages for all the slots.
+static int
+proc_mapstack(struct proc *p)
+{
+  char *pa;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  if((pa = kalloc()) == 0)
+    return -1;
+  p->kstack = KSTACK((int)(((uint64)p - KERNBASE) / PGSIZE));
+  if(mappages(kernel_pagetable, p->kstack, PGSIZE, (uint64)pa, PTE_R | PTE_W) < 0){
+    kfree(pa);
+    return -1;
   }
+  return 0;
+}
+
+// Unmap and free p's kernel stack. other harts may still
+// have the mapping in their TLBs, but scheduler() flushes
+// them before running any proc on the stack's slot again.
+static void
+proc_unmapstack(struct proc *p)
+{
+  uvmunmap(kernel_pagetable, p->kstack, 1, 1);
 }
 
 // initialize the proc table at boot time.
 void
 procinit(void)
 {
-  struct proc *p;
+  struct sleepq *q;
   
   initlock(&pid_lock, "nextpid");
-  initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  initlock(&futex_lock, "futex");
+  for(q = sleepqs; q < &sleepqs[NSLEEPQ]; q++)
+      initlock(&q->lock, "sleepq");
 }
 
 // Must be called with interrupts disabled,
@@ -85,54 +124,262 @@ myproc(void) {
   return p;
 }
 
-int
-allocpid() {
-  int pid;
-  
+// Give p a pid and make it visible to pidlookup().
+static void
+allocpid(struct proc *p) {
   acquire(&pid_lock);
-  pid = nextpid;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  p->pidnext = pidhash[p->pid % NPIDHASH];
+  pidhash[p->pid % NPIDHASH] = p;
   release(&pid_lock);
-
-  return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Return the live proc with the given pid, or 0.
+// pid_lock must be held.
 static struct proc*
-allocproc(void)
+pidlookup(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  if(pid <= 0)
+    return 0;
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Create an address space holding no user memory, just the
+// trampoline, the usyscall page for pid, and tf in slot 0.
+// Returns 0 if out of memory.
+struct vmspace*
+vmcreate(struct trapframe *tf, int pid)
+{
+  struct vmspace *vm;
+
+  if((vm = (struct vmspace *)kalloc()) == 0)
+    return 0;
+  memset(vm, 0, sizeof(*vm));
+  initlock(&vm->lock, "vmspace");
+  vm->ref = 1;
+  vm->tfslots = 1;
+
+  // Allocate a page to share read-only with user space.
+  if((vm->usyscall = (struct usyscall *)kalloc()) == 0)
+    goto bad;
+  memset(vm->usyscall, 0, PGSIZE);
+  vm->usyscall->pid[0] = pid;
+  vm->usyscall->clockfreq = CLINT_FREQ;
+  vm->usyscall->tickcycles = CLINT_INTERVAL;
+
+  // An empty user page table.
+  if((vm->pagetable = proc_pagetable(vm, tf)) == 0){
+    kfree((void*)vm->usyscall);
+    goto bad;
+  }
+  return vm;
+
+bad:
+  kfree((void*)vm);
+  return 0;
+}
+
+// Add p, a new thread, to the address space vm: map its
+// trapframe in a free slot. Returns 0 on success, or -1
+// if vm has NTHREAD threads already or out of memory.
+static int
+vmjoin(struct vmspace *vm, struct proc *p)
+{
+  int i;
+
+  acquire(&vm->lock);
+  for(i = 1; i < NTHREAD; i++)
+    if((vm->tfslots & (1 << i)) == 0)
+      break;
+  if(i == NTHREAD ||
+     mappages(vm->pagetable, TRAPFRAMESLOT(i), PGSIZE,
+              (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
+    release(&vm->lock);
+    return -1;
   }
+  vm->tfslots |= 1 << i;
+  vm->usyscall->pid[i] = p->pid;
+  vm->ref++;
+  release(&vm->lock);
+  p->vm = vm;
+  p->pagetable = vm->pagetable;
+  p->tfslot = i;
   return 0;
+}
+
+// Drop a reference to vm, freeing it and its user
+// memory with the last one. Trapframes still mapped
+// in it belong to their procs and are not freed.
+void
+vmput(struct vmspace *vm)
+{
+  acquire(&vm->lock);
+  if(vm->ref > 1){
+    vm->ref--;
+    release(&vm->lock);
+    return;
+  }
+  release(&vm->lock);
+
+  // the last user; nobody else can see vm now.
+  ringfree(vm);
+  proc_freepagetable(vm);
+  kfree((void*)vm);
+}
+
+// Take p out of its address space, for exit or exec:
+// unmap its trapframe and drop its reference.
+void
+vmleave(struct proc *p)
+{
+  struct vmspace *vm = p->vm;
+
+  acquire(&vm->lock);
+  uvmunmap(vm->pagetable, TRAPFRAMESLOT(p->tfslot), 1, 0);
+  vm->tfslots &= ~(1 << p->tfslot);
+  vm->usyscall->pid[p->tfslot] = 0;
+  release(&vm->lock);
+  vmput(vm);
+  p->vm = 0;
+  p->pagetable = 0;
+  p->tfslot = 0;
+}
+
+// The current directory, which the threads of an address
+// space share. The caller must iput() it.
+struct inode*
+cwdget(void)
+{
+  struct vmspace *vm = myproc()->vm;
+  struct inode *ip;
+
+  acquire(&vm->lock);
+  ip = idup(vm->cwd);
+  release(&vm->lock);
+  return ip;
+}
+
+// Make ip the current directory of the caller and its
+// threads. Returns the old one, which the caller must iput().
+struct inode*
+cwdset(struct inode *ip)
+{
+  struct vmspace *vm = myproc()->vm;
+  struct inode *old;
+
+  acquire(&vm->lock);
+  old = vm->cwd;
+  vm->cwd = ip;
+  release(&vm->lock);
+  return old;
+}
+
+// A proc is done with vm's current directory, for exit
+// or exec. Returns it if that was the last user, for the
+// caller to iput() in a transaction, or else 0.
+struct inode*
+cwdput(struct vmspace *vm)
+{
+  struct inode *ip = 0;
 
-found:
-  p->pid = allocpid();
+  acquire(&vm->lock);
+  if(--vm->nlive == 0){
+    ip = vm->cwd;
+    vm->cwd = 0;
+  }
+  release(&vm->lock);
+  // for vmsolo(); not under vm->lock, see vmunlocksz().
+  wakeup(&vm->nlive);
+  return ip;
+}
+
+// Kill the other threads of p's address space, for exec(),
+// and wait until they have exited. Returns -1 if p is killed
+// while it waits, else 0.
+int
+vmsolo(struct proc *p)
+{
+  struct vmspace *vm = p->vm;
+  struct proc *q;
+  int i;
+
+  acquire(&vm->lock);
+  while(vm->nlive > 1 && !p->killed){
+    release(&vm->lock);
+    // again after each wakeup, in case a dying thread
+    // cloned another meanwhile.
+    acquire(&pid_lock);
+    for(i = 0; i < NPIDHASH; i++){
+      for(q = pidhash[i]; q; q = q->pidnext){
+        if(q == p)
+          continue;
+        acquire(&q->lock);
+        if(q->vm == vm){
+          q->killed = 1;
+          if(q->state == SLEEPING)
+            setrunnable(q);
+        }
+        release(&q->lock);
+      }
+    }
+    release(&pid_lock);
+    acquire(&vm->lock);
+    if(vm->nlive > 1 && !p->killed)
+      sleep(&vm->nlive, &vm->lock);
+  }
+  i = vm->nlive > 1 ? -1 : 0;
+  release(&vm->lock);
+  return i;
+}
+
+// Allocate a page for a new proc, and its kernel stack.
+// Initialize state required to run in the kernel,
+// and return with p->lock held. The proc gets a new, empty
+// address space, or joins vm as a thread if vm is non-zero.
+// If a memory allocation fails, return 0.
+static struct proc*
+allocproc(struct vmspace *vm)
+{
+  struct proc *p;
+
+  if((p = (struct proc *)kalloc()) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  initlock(&p->waitlock, "waitlock");
   p->state = USED;
+  p->sclass = &fairclass;
+  if(proc_mapstack(p) < 0){
+    kfree((void*)p);
+    return 0;
+  }
+  allocpid(p);
+  acquire(&p->lock);
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
-    freeproc(p);
-    release(&p->lock);
-    return 0;
+  if(vm){
+    if(vmjoin(vm, p) < 0){
+      freeproc(p);
+      return 0;
+    }
+  } else {
+    if((p->vm = vmcreate(p->trapframe, p->pid)) == 0){
+      freeproc(p);
+      return 0;
+    }
+    p->pagetable = p->vm->pagetable;
+    p->tfslot = 0;
   }
 
   // Set up new context to start executing at forkret,
@@ -145,31 +392,39 @@ found:
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including user pages and its kernel stack.
+// p->lock must be held; freeproc() releases it.
 static void
 freeproc(struct proc *p)
 {
+  struct proc **pp;
+
+  if(p->vm)
+    vmleave(p);
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
   p->state = UNUSED;
+  release(&p->lock);
+
+  // once off the hash chain, nothing can find p; anyone
+  // who found it before holds pid_lock until done with it.
+  acquire(&pid_lock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pid_lock);
+  proc_unmapstack(p);
+  kfree((void*)p);
 }
 
-// Create a user page table for a given process,
+// Create a user page table for a new address space,
 // with no user memory, but with trampoline pages.
-pagetable_t
-proc_pagetable(struct proc *p)
+static pagetable_t
+proc_pagetable(struct vmspace *vm, struct trapframe *tf)
 {
   pagetable_t pagetable;
 
@@ -190,8 +445,18 @@ proc_pagetable(struct proc *p)
 
   // map the trapframe just below TRAMPOLINE, for trampoline.S.
   if(mappages(pagetable, TRAPFRAME, PGSIZE,
-              (uint64)(p->trapframe), PTE_R | PTE_W) < 0){
+              (uint64)tf, PTE_R | PTE_W) < 0){
+    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmfree(pagetable, 0);
+    return 0;
+  }
+
+  // map the usyscall page just below TRAPFRAME, readable
+  // but not writable by user code.
+  if(mappages(pagetable, USYSCALL, PGSIZE,
+              (uint64)(vm->usyscall), PTE_R | PTE_U) < 0){
     uvmunmap(pagetable, TRAMPOLINE, 1, 0);
+    uvmunmap(pagetable, TRAPFRAME, 1, 0);
     uvmfree(pagetable, 0);
     return 0;
   }
@@ -199,14 +464,19 @@ proc_pagetable(struct proc *p)
   return pagetable;
 }
 
-// Free a process's page table, and free the
-// physical memory it refers to.
-void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+// Free an address space's page table, and free the
+// physical memory it refers to, except trapframes.
+static void
+proc_freepagetable(struct vmspace *vm)
 {
-  uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
-  uvmfree(pagetable, sz);
+  int i;
+
+  for(i = 0; i < NTHREAD; i++)
+    if(vm->tfslots & (1 << i))
+      uvmunmap(vm->pagetable, TRAPFRAMESLOT(i), 1, 0);
+  uvmunmap(vm->pagetable, TRAMPOLINE, 1, 0);
+  uvmunmap(vm->pagetable, USYSCALL, 1, 1);
+  uvmfree(vm->pagetable, vm->sz);
 }
 
 // a user program that calls exec("/init")
@@ -227,110 +497,404 @@ userinit(void)
 {
   struct proc *p;
 
-  p = allocproc();
+  p = allocproc(0);
   initproc = p;
   
   // allocate one user page and copy init's instructions
   // and data into it.
   uvminit(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  p->vm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->epc = 0;      // user program counter
   p->trapframe->sp = PGSIZE;  // user stack pointer
+  p->trapframe->tp = USYSCALLPID(0);
 
   safestrcpy(p->name, "initcode", sizeof(p->name));
-  p->cwd = namei("/");
+  p->vm->cwd = namei("/");
+  p->vm->nlive = 1;
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Wait until no other hart can still be using user memory
+// that was just unmapped from vm. a hart only holds on to
+// vm's translations while running one of its threads: in
+// user mode in its TLB, which uservec and userret in
+// trampoline.S flush whenever they switch page tables, or in
+// the kernel inside copyin() &c, which don't switch away.
+// so it is enough to see each such hart trap, return to user
+// space, or switch threads, each of which bumps its tlbgen;
+// the next timer interrupt guarantees one of them.
+static void
+tlbshootdown(struct vmspace *vm)
+{
+  struct cpu *c, *me;
+  uint64 gen;
+
+  __sync_synchronize();
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    push_off();
+    me = mycpu();
+    pop_off();
+    if(c == me)
+      continue;
+    gen = c->tlbgen;
+    __sync_synchronize();
+    while(c->vm == vm && c->tlbgen == gen){
+      acquire(&tickslock);
+      sleep(&ticks, &tickslock);
+      release(&tickslock);
+    }
+  }
+}
+
+// Shrink vm from oldsz to newsz and return newsz. if other
+// threads may be running on other harts, unmap the pages
+// first and free them only after tlbshootdown().
+static uint64
+vmshrink(struct vmspace *vm, uint64 oldsz, uint64 newsz)
+{
+  uint64 *pa, a;
+  pte_t *pte;
+  int i, n;
+
+  if(newsz >= oldsz)
+    return oldsz;
+  if(vm->ref == 1)
+    return uvmdealloc(vm->pagetable, oldsz, newsz);
+
+  // a page of physical addresses to free, a page's worth at a time.
+  if((pa = (uint64 *)kalloc()) == 0)
+    return oldsz;
+  while(PGROUNDUP(newsz) < PGROUNDUP(oldsz)){
+    n = 0;
+    for(a = PGROUNDUP(oldsz); a > PGROUNDUP(newsz) && n < PGSIZE/sizeof(uint64); ){
+      a -= PGSIZE;
+      if((pte = walk(vm->pagetable, a, 0)) == 0 || (*pte & PTE_V) == 0)
+        panic("vmshrink");
+      pa[n++] = PTE2PA(*pte);
+      *pte = 0;
+    }
+    oldsz = a;
+    tlbshootdown(vm);
+    for(i = 0; i < n; i++)
+      kfree((void*)pa[i]);
+  }
+  kfree((void*)pa);
+  return newsz;
+}
+
+// Take exclusive use of vm->sz and the user memory mapping,
+// sleeping while another thread grows, shrinks or copies it.
+static void
+vmlocksz(struct vmspace *vm)
+{
+  acquire(&vm->lock);
+  while(vm->growing)
+    sleep(&vm->growing, &vm->lock);
+  vm->growing = 1;
+  release(&vm->lock);
+}
+
+static void
+vmunlocksz(struct vmspace *vm)
+{
+  acquire(&vm->lock);
+  vm->growing = 0;
+  release(&vm->lock);
+  // not under vm->lock: allocproc() holds a p->lock when it
+  // takes vm->lock, and wakeup() takes sleepers' p->locks.
+  wakeup(&vm->growing);
+}
+
+// Grow or shrink user memory by n bytes, and set *oldsz to
+// the size before. Return 0 on success, -1 on failure.
 int
-growproc(int n)
+growproc(int n, uint64 *oldsz)
 {
-  uint sz;
-  struct proc *p = myproc();
+  uint64 sz;
+  struct vmspace *vm = myproc()->vm;
 
-  sz = p->sz;
+  vmlocksz(vm);
+  sz = *oldsz = vm->sz;
   if(n > 0){
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if((sz = uvmalloc(vm->pagetable, sz, sz + n)) == 0) {
+      vmunlocksz(vm);
       return -1;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    sz = vmshrink(vm, sz, sz + n);
   }
-  p->sz = sz;
+  vm->sz = sz;
+  vmunlocksz(vm);
   return 0;
 }
 
+// Add np to p's list of children.
+// p->waitlock must be held.
+static void
+addchild(struct proc *p, struct proc *np)
+{
+  np->prevsib = 0;
+  np->nextsib = p->children;
+  if(p->children)
+    p->children->prevsib = np;
+  p->children = np;
+}
+
+// Give np, a new child of p, p's open files and current
+// directory and let it run. a thread shares the directory,
+// a forked child gets its own. Returns np's pid.
+// np->lock must be held, and is released.
+static int
+startchild(struct proc *p, struct proc *np)
+{
+  int i, pid;
+
+  // increment reference counts on open file descriptors.
+  for(i = 0; i < NOFILE; i++)
+    if(p->ofile[i])
+      np->ofile[i] = filedup(p->ofile[i]);
+  if(np->vm == p->vm){
+    acquire(&p->vm->lock);
+    p->vm->nlive++;
+    release(&p->vm->lock);
+  } else {
+    np->vm->cwd = cwdget();
+    np->vm->nlive = 1;
+  }
+
+  safestrcpy(np->name, p->name, sizeof(p->name));
+  np->tracemask = p->tracemask;
+
+  // start level with the parent.
+  np->sclass = p->sclass;
+  np->nice = p->nice;
+  np->rq = p->rq;
+  np->vruntime = p->vruntime;
+
+  pid = np->pid;
+  np->parent = p;
+
+  release(&np->lock);
+
+  acquire(&p->waitlock);
+  addchild(p, np);
+  release(&p->waitlock);
+
+  acquire(&np->lock);
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
 // Create a new process, copying the parent.
 // Sets up child kernel stack to return as if from fork() system call.
 int
 fork(void)
 {
-  int i, pid;
+  int pid;
   struct proc *np;
   struct proc *p = myproc();
 
+  // keep other threads from changing memory under the copy.
+  vmlocksz(p->vm);
+
   // Allocate process.
-  if((np = allocproc()) == 0){
+  if((np = allocproc(0)) == 0){
+    vmunlocksz(p->vm);
     return -1;
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  if(uvmcopy(p->pagetable, np->pagetable, p->vm->sz) < 0){
     freeproc(np);
-    release(&np->lock);
+    vmunlocksz(p->vm);
+    return -1;
+  }
+  np->vm->sz = p->vm->sz;
+
+  // the child gets its own copy of the submission ring.
+  if(ringcopy(p->vm, np->vm) < 0){
+    freeproc(np);
+    vmunlocksz(p->vm);
     return -1;
   }
-  np->sz = p->sz;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
 
   // Cause fork to return 0 in the child.
   np->trapframe->a0 = 0;
+  np->trapframe->tp = USYSCALLPID(0);
 
-  // increment reference counts on open file descriptors.
-  for(i = 0; i < NOFILE; i++)
-    if(p->ofile[i])
-      np->ofile[i] = filedup(p->ofile[i]);
-  np->cwd = idup(p->cwd);
+  // after startchild() releases np->lock, since
+  // vmunlocksz() calls wakeup().
+  pid = startchild(p, np);
+  vmunlocksz(p->vm);
+  return pid;
+}
 
-  safestrcpy(np->name, p->name, sizeof(p->name));
+// Create a thread: a child process that shares the caller's
+// address space, and starts at fn(arg) on the given stack.
+// fn must not return; the thread ends by calling exit().
+// Open files are shared as after fork(), not the descriptor
+// table: files the thread opens later are its own.
+int
+clone(uint64 fn, uint64 arg, uint64 stack)
+{
+  struct proc *np;
+  struct proc *p = myproc();
 
-  pid = np->pid;
+  if((np = allocproc(p->vm)) == 0){
+    return -1;
+  }
 
-  release(&np->lock);
+  *(np->trapframe) = *(p->trapframe);
+  np->trapframe->epc = fn;
+  np->trapframe->a0 = arg;
+  np->trapframe->sp = stack;
+  np->trapframe->ra = 0;
+  np->trapframe->tp = USYSCALLPID(np->tfslot);
 
-  acquire(&wait_lock);
-  np->parent = p;
-  release(&wait_lock);
+  return startchild(p, np);
+}
 
-  acquire(&np->lock);
-  np->state = RUNNABLE;
-  release(&np->lock);
+// Physical address of the futex word at user address addr,
+// which is the same in every thread of the address space.
+static uint64
+futexkey(struct proc *p, uint64 addr)
+{
+  uint64 pa;
 
-  return pid;
+  if(addr % sizeof(int) != 0)
+    return 0;
+  if((pa = walkaddr(p->pagetable, PGROUNDDOWN(addr))) == 0)
+    return 0;
+  return pa + (addr - PGROUNDDOWN(addr));
 }
 
-// Pass p's abandoned children to init.
-// Caller must hold wait_lock.
-void
-reparent(struct proc *p)
+// Sleep until futexwake() on addr, if the int there is
+// still val. Returns 0 if woken, -1 if the value had
+// changed, addr is bad, or the thread was killed.
+int
+futexwait(uint64 addr, int val)
 {
-  struct proc *pp;
+  struct proc *p = myproc();
+  uint64 key;
+  int v;
+
+  // a futexwake() that follows a change to *addr can't slip
+  // between the check below and sleep(), since both hold futex_lock.
+  acquire(&futex_lock);
+  if((key = futexkey(p, addr)) == 0 ||
+     copyin(p->pagetable, (char *)&v, addr, sizeof(v)) < 0 ||
+     v != val || p->killed){
+    release(&futex_lock);
+    return -1;
+  }
+  sleep((void*)key, &futex_lock);
+  release(&futex_lock);
+  return p->killed ? -1 : 0;
+}
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+// Wake up to n threads sleeping in futexwait() on addr.
+// Returns the number woken, or -1 if addr is bad.
+int
+futexwake(uint64 addr, int n)
+{
+  struct proc *p;
+  struct sleepq *q;
+  uint64 key;
+  int woken;
+
+  acquire(&futex_lock);
+  if((key = futexkey(myproc(), addr)) == 0){
+    release(&futex_lock);
+    return -1;
+  }
+  woken = 0;
+  q = sleepq((void*)key);
+  acquire(&q->lock);
+  for(p = q->head; p && woken < n; p = p->qnext) {
+    if(p != myproc()){
+      acquire(&p->lock);
+      if(p->state == SLEEPING && p->chan == (void*)key) {
+        setrunnable(p);
+        woken++;
+      }
+      release(&p->lock);
     }
   }
+  release(&q->lock);
+  release(&futex_lock);
+  return woken;
+}
+
+// Wake p if it sleeps on chan. unlike wakeup(),
+// looks at no other procs.
+static void
+wakeproc(struct proc *p, void *chan)
+{
+  acquire(&p->lock);
+  if(p->state == SLEEPING && p->chan == chan)
+    setrunnable(p);
+  release(&p->lock);
+}
+
+// Lock p and its parent's waitlock, and return the parent.
+// p->lock keeps p->parent, and so the parent, from going
+// away, but reparent() takes them in the other order, so
+// back off if the parent's waitlock is held.
+static struct proc*
+lockparent(struct proc *p)
+{
+  struct proc *pp;
+
+  for(;;){
+    acquire(&p->lock);
+    pp = p->parent;
+    if(tryacquire(&pp->waitlock))
+      return pp;
+    release(&p->lock);
+  }
+}
+
+// Pass p's abandoned children, and any zombies among
+// them, to init.
+static void
+reparent(struct proc *p)
+{
+  struct proc *pp, *last;
+
+  acquire(&p->waitlock);
+  if(p->children == 0){
+    release(&p->waitlock);
+    return;
+  }
+  acquire(&initproc->waitlock);
+  for(pp = p->children; pp; pp = last){
+    last = pp->nextsib;
+    acquire(&pp->lock);
+    pp->parent = initproc;
+    release(&pp->lock);
+    addchild(initproc, pp);
+  }
+  p->children = 0;
+  if(p->zombies){
+    for(last = p->zombies; last->nextzombie; last = last->nextzombie)
+      ;
+    last->nextzombie = initproc->zombies;
+    initproc->zombies = p->zombies;
+    p->zombies = 0;
+    wakeproc(initproc, initproc);
+  }
+  release(&initproc->waitlock);
+  release(&p->waitlock);
 }
 
 // Exit the current process.  Does not return.
@@ -340,6 +904,8 @@ void
 exit(int status)
 {
   struct proc *p = myproc();
+  struct proc *pp;
+  struct inode *ip;
 
   if(p == initproc)
     panic("init exiting");
@@ -353,84 +919,226 @@ exit(int status)
     }
   }
 
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
-
-  acquire(&wait_lock);
+  if((ip = cwdput(p->vm)) != 0){
+    begin_op();
+    iput(ip);
+    end_op();
+  }
 
-  // Give any children to init.
+  // Give any children to init. p forks no more, so
+  // none can be added after this.
   reparent(p);
 
+  pp = lockparent(p);
+
   // Parent might be sleeping in wait().
-  wakeup(p->parent);
-  
-  acquire(&p->lock);
+  wakeproc(pp, pp);
 
   p->xstate = status;
   p->state = ZOMBIE;
+  p->nextzombie = pp->zombies;
+  pp->zombies = p;
 
-  release(&wait_lock);
+  release(&pp->waitlock);
 
   // Jump into the scheduler, never to return.
   sched();
   panic("zombie exit");
 }
 
-// Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// time in the kernel: p's run time less its user time,
+// which is charged at different moments.
+static uint64
+procstime(struct proc *p)
+{
+  return p->runtime > p->u.utime ? p->runtime - p->u.utime : 0;
+}
+
+// Add np's usage, and that of its waited-for children, to *u.
+static void
+addusage(struct usage *u, struct proc *np)
+{
+  u->utime += np->u.utime + np->cu.utime;
+  u->stime += procstime(np) + np->cu.stime;
+  u->nvcsw += np->u.nvcsw + np->cu.nvcsw;
+  u->nivcsw += np->u.nivcsw + np->cu.nivcsw;
+  u->rbytes += np->u.rbytes + np->cu.rbytes;
+  u->wbytes += np->u.wbytes + np->cu.wbytes;
+  u->rblocks += np->u.rblocks + np->cu.rblocks;
+  u->cycles += np->u.cycles + np->cu.cycles;
+  u->instret += np->u.instret + np->cu.instret;
+}
+
+// time CSR ticks to microseconds.
+static uint64
+tickstous(uint64 t)
+{
+  return t / (CLINT_FREQ / 1000000);
+}
+
+static void
+userusage(struct rusage *ru, struct usage *u)
+{
+  ru->utime = tickstous(u->utime);
+  ru->stime = tickstous(u->stime);
+  ru->nvcsw = u->nvcsw;
+  ru->nivcsw = u->nivcsw;
+  ru->rbytes = u->rbytes;
+  ru->wbytes = u->wbytes;
+  ru->rblocks = u->rblocks;
+  ru->cycles = u->cycles;
+  ru->instret = u->instret;
+}
+
+// Copy the usage of the current process, or of its
+// waited-for children, to user address addr as a struct
+// rusage. Returns 0, or -1 if who or addr is bad.
 int
-wait(uint64 addr)
+getrusage(int who, uint64 addr)
 {
-  struct proc *np;
-  int havekids, pid;
   struct proc *p = myproc();
+  struct rusage ru;
+  struct usage u;
 
-  acquire(&wait_lock);
+  if(who == RUSAGE_SELF){
+    acquire(&p->lock);
+    u = p->u;
+    u.stime = procstime(p);
+    // add the counts since p was last charged, so that
+    // a benchmark can time a short stretch of code.
+    u.cycles += r_cycle() - p->cyclestamp;
+    u.instret += r_instret() - p->instretstamp;
+    release(&p->lock);
+  } else if(who == RUSAGE_CHILDREN){
+    u = p->cu;
+  } else {
+    return -1;
+  }
+  userusage(&ru, &u);
+  return copyout(p->pagetable, addr, (char *)&ru, sizeof(ru));
+}
 
-  for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
+// Copy a struct procinfo for each of up to n processes
+// to user address addr. Returns the number copied, or
+// -1 if addr is bad.
+int
+procinfo(uint64 addr, int n)
+{
+  struct proc *p;
+  struct procinfo pi;
+  struct usage u;
+  int i, j;
 
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
+  j = 0;
+  acquire(&pid_lock);
+  for(i = 0; i < NPIDHASH; i++){
+    for(p = pidhash[i]; p && j < n; p = p->pidnext){
+      acquire(&p->lock);
+      if(p->state == UNUSED){
+        release(&p->lock);
+        continue;
+      }
+      memset(&pi, 0, sizeof(pi));
+      pi.pid = p->pid;
+      // p->lock keeps p->parent from going away.
+      pi.ppid = p->parent ? p->parent->pid : 0;
+      pi.state = p->state;
+      pi.nice = p->nice;
+      safestrcpy(pi.name, p->name, sizeof(pi.name));
+      u = p->u;
+      u.stime = procstime(p);
+      release(&p->lock);
+      userusage(&pi.ru, &u);
+      if(copyout(myproc()->pagetable, addr + j*sizeof(pi), (char *)&pi, sizeof(pi)) < 0){
+        release(&pid_lock);
+        return -1;
+      }
+      j++;
+    }
+  }
+  release(&pid_lock);
+  return j;
+}
+
+// Copy a struct cpuinfo for each of up to n CPUs that
+// have started to user address addr. Returns the number
+// copied, or -1 if addr is bad.
+int
+cpuinfo(uint64 addr, int n)
+{
+  struct cpuinfo ci;
+  int i;
+
+  for(i = 0; i < n && i < NCPU && cpus[i].ticks > 0; i++){
+    ci.busy = tickstous(cpus[i].busy);
+    ci.user = tickstous(cpus[i].utime);
+    if(copyout(myproc()->pagetable, addr + i*sizeof(ci), (char *)&ci, sizeof(ci)) < 0)
+      return -1;
+  }
+  return i;
+}
+
+// Wait for the child process pid, or any child if pid
+// is -1, to exit and return its pid.
+// Return -1 if this process has no such child.
+int
+waitpid(int pid, uint64 addr)
+{
+  struct proc *np, **zp;
+  int havekids;
+  struct proc *p = myproc();
+
+  acquire(&p->waitlock);
+
+  for(;;){
+    // Look for an exited child.
+    for(zp = &p->zombies; (np = *zp) != 0; zp = &np->nextzombie)
+      if(pid == -1 || np->pid == pid)
+        break;
+    if(np){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+
+      pid = np->pid;
+      if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
+                              sizeof(np->xstate)) < 0) {
         release(&np->lock);
+        release(&p->waitlock);
+        return -1;
       }
+      *zp = np->nextzombie;
+      if(np->prevsib)
+        np->prevsib->nextsib = np->nextsib;
+      else
+        p->children = np->nextsib;
+      if(np->nextsib)
+        np->nextsib->prevsib = np->prevsib;
+      addusage(&p->cu, np);
+      freeproc(np);
+      release(&p->waitlock);
+      return pid;
     }
 
-    // No point waiting if we don't have any children.
+    havekids = 0;
+    for(np = p->children; np && !havekids; np = np->nextsib)
+      if(pid == -1 || np->pid == pid)
+        havekids = 1;
+
+    // No point waiting if we don't have any such children.
     if(!havekids || p->killed){
-      release(&wait_lock);
+      release(&p->waitlock);
       return -1;
     }
     
     // Wait for a child to exit.
-    sleep(p, &wait_lock);  //DOC: wait-sleep
+    sleep(p, &p->waitlock);  //DOC: wait-sleep
   }
 }
 
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
-//  - choose a process to run.
+//  - choose a process to run (see sched.c).
 //  - swtch to start running that process.
 //  - eventually that process transfers control
 //    via swtch back to the scheduler.
@@ -445,22 +1153,33 @@ scheduler(void)
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
-      }
-      release(&p->lock);
-    }
+    if((p = schedpick()) == 0)
+      continue;
+    acquire(&p->lock);
+    if(p->state != RUNNABLE)
+      panic("scheduler");
+
+    // Switch to chosen process.  It is the process's job
+    // to release its lock and then reacquire it
+    // before jumping back to us.
+    p->state = RUNNING;
+    c->proc = p;
+    c->vm = p->vm;
+    schedswitch(p, 1);
+    ktrace(KT_SCHED, KE_SWITCHIN, p->pid, 0, 0, p->name);
+    // p's kernel stack may sit where a freed proc's did,
+    // so drop any translation this hart has for the old one.
+    sfence_vma();
+    swtch(&c->context, &p->context);
+
+    // Process is done running for now.
+    // It should have changed its p->state before coming back.
+    ktrace(KT_SCHED, KE_SWITCHOUT, p->pid, p->state, 0, p->name);
+    schedswitch(p, 0);
+    c->proc = 0;
+    c->vm = 0;
+    c->tlbgen++;
+    release(&p->lock);
   }
 }
 
@@ -497,7 +1216,8 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  p->u.nivcsw++;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -523,12 +1243,52 @@ forkret(void)
   usertrapret();
 }
 
+// A kernel thread's very first scheduling by scheduler()
+// will swtch here.
+static void
+kthreadstart(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+  p->kfn();
+  panic("kthread returned");
+}
+
+// Start a process that runs fn in the kernel, and never
+// returns to user space. fn must not return either.
+void
+kthread(void (*fn)(void), char *name)
+{
+  struct proc *p;
+
+  if((p = allocproc(0)) == 0)
+    panic("kthread");
+  p->kfn = fn;
+  p->context.ra = (uint64)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+  setrunnable(p);
+  release(&p->lock);
+}
+
 // Atomically release lock and sleep on chan.
 // Reacquires lock when awakened.
 void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
+  struct sleepq *q = sleepq(chan);
+
+  // Go on chan's sleep queue while still holding lk,
+  // so that a wakeup() after lk is released finds p.
+  acquire(&q->lock);
+  p->qprev = 0;
+  p->qnext = q->head;
+  if(q->head)
+    q->head->qprev = p;
+  q->head = p;
+  release(&q->lock);
   
   // Must acquire p->lock in order to
   // change p->state and then call sched.
@@ -543,14 +1303,25 @@ sleep(void *chan, struct spinlock *lk)
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  p->u.nvcsw++;
+  ktrace(KT_SLEEP, KE_SLEEP, p->pid, (uint64)chan, 0, p->name);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  acquire(&q->lock);
+  if(p->qprev)
+    p->qprev->qnext = p->qnext;
+  else
+    q->head = p->qnext;
+  if(p->qnext)
+    p->qnext->qprev = p->qprev;
+  release(&q->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
@@ -560,16 +1331,19 @@ void
 wakeup(void *chan)
 {
   struct proc *p;
+  struct sleepq *q = sleepq(chan);
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  acquire(&q->lock);
+  for(p = q->head; p; p = p->qnext) {
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        setrunnable(p);
       }
       release(&p->lock);
     }
   }
+  release(&q->lock);
 }
 
 // Kill the process with the given pid.
@@ -580,20 +1354,44 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  acquire(&pid_lock);
+  if((p = pidlookup(pid)) == 0){
+    release(&pid_lock);
+    return -1;
   }
-  return -1;
+  acquire(&p->lock);
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
+  }
+  release(&p->lock);
+  release(&pid_lock);
+  return 0;
+}
+
+// Set the nice value of the process with the given pid,
+// clamped to NICE_MIN..NICE_MAX. it applies to the time
+// the process runs from now on.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if(nice < NICE_MIN)
+    nice = NICE_MIN;
+  if(nice > NICE_MAX)
+    nice = NICE_MAX;
+  acquire(&pid_lock);
+  if((p = pidlookup(pid)) == 0){
+    release(&pid_lock);
+    return -1;
+  }
+  acquire(&p->lock);
+  p->nice = nice;
+  release(&p->lock);
+  release(&pid_lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -628,7 +1426,9 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)
 
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
+// holds pid_lock, so that freeproc() can't free a proc on
+// the hash chains under it, but only tries for it, to
+// avoid wedging a stuck machine further.
 void
 procdump(void)
 {
@@ -641,16 +1441,24 @@ procdump(void)
   };
   struct proc *p;
   char *state;
+  int i;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
-    printf("\n");
+  if(!tryacquire(&pid_lock)){
+    printf("procdump: pid_lock busy\n");
+    return;
   }
+  for(i = 0; i < NPIDHASH; i++){
+    for(p = pidhash[i]; p; p = p->pidnext){
+      if(p->state == UNUSED)
+        continue;
+      if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+        state = states[p->state];
+      else
+        state = "???";
+      printf("%d %s %s", p->pid, state, p->name);
+      printf("\n");
+    }
+  }
+  release(&pid_lock);
 }
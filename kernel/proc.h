@@ -24,6 +24,12 @@ struct cpu {
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  uint64 ticks;               // Timer interrupts taken by this cpu.
+  uint64 tlbgen;              // Bumped when this cpu forgets user mappings.
+  struct vmspace *vm;         // Address space of proc, for tlbshootdown().
+  uint64 busy;                // Time CSR ticks spent running procs.
+  uint64 utime;               // Of which in user space.
+  int resched;                // Yield at the next chance; see setrunnable().
 };
 
 extern struct cpu cpus[NCPU];
@@ -80,11 +86,44 @@ struct trapframe {
   /* 280 */ uint64 t6;
 };
 
+// A user address space. fork() and exec() make a new one; clone()
+// shares it with the new thread. Freed when its last user goes.
+struct vmspace {
+  struct spinlock lock;
+
+  // vm->lock must be held when using these:
+  int ref;                     // Number of procs using this address space
+  uint tfslots;                // TRAPFRAMESLOT()s in use, one bit each
+  int growing;                 // growproc() or fork() is using sz
+  struct inode *cwd;           // Current directory, shared by the threads
+  int nlive;                   // Live procs in it, which exit and exec drop; see cwdput()
+
+  uint64 sz;                   // Size of user memory (bytes)
+  pagetable_t pagetable;       // User page table
+  struct usyscall *usyscall;   // data page mapped read-only at USYSCALL
+  struct ring *ring;           // submission ring mapped at URING, or 0
+};
+
+// Resource usage counters; see rusage.h for the user's view.
+// times are in time CSR ticks.
+struct usage {
+  uint64 utime;
+  uint64 stime;
+  uint64 nvcsw;
+  uint64 nivcsw;
+  uint64 rbytes;
+  uint64 wbytes;
+  uint64 rblocks;
+  uint64 cycles;
+  uint64 instret;
+};
+
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
 struct proc {
   struct spinlock lock;
+  struct spinlock waitlock;    // Protects the child lists; see lockparent()
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
@@ -92,17 +131,51 @@ struct proc {
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
+  struct schedclass *sclass;   // Scheduling class
+  int nice;                    // Nice value, NICE_MIN..NICE_MAX
+  int rq;                      // CPU whose run queue p was last on
+  uint64 vruntime;             // Weighted run time; fixed while queued
+  uint64 runtime;              // Time run, in time CSR ticks
+  uint64 schedstamp;           // When runtime was last charged
+  uint64 cyclestamp;           // cycle CSR when p->u.cycles was last charged
+  uint64 instretstamp;         // instret CSR, likewise
+  struct proc *rqleft;         // Run queue heap links, while RUNNABLE
+  struct proc *rqright;
+  int rqrank;                  // Length of right spine of p's subheap
 
-  // wait_lock must be held when using this:
+  // parent->waitlock must be held when using these,
+  // and p->lock too to change parent:
   struct proc *parent;         // Parent process
+  struct proc *nextsib;        // Next in parent->children
+  struct proc *prevsib;        // Previous in parent->children, or 0
+  struct proc *nextzombie;     // Next in parent->zombies
+
+  // p->waitlock must be held when using these:
+  struct proc *children;       // Child processes, live or zombie
+  struct proc *zombies;        // Children that have exited, not yet waited for
+
+  // pid_lock must be held when using this:
+  struct proc *pidnext;        // Next in pid hash chain
+
+  // chan's sleep queue lock must be held when using these:
+  struct proc *qnext;          // Next in sleep queue
+  struct proc *qprev;          // Previous in sleep queue, or 0
+
+  // the sleeplock's lk must be held when using this:
+  struct proc *slnext;         // Next waiter for a sleeplock
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;       // User page table
+  struct vmspace *vm;          // User address space
+  pagetable_t pagetable;       // User page table, vm->pagetable
   struct trapframe *trapframe; // data page for trampoline.S
+  int tfslot;                  // trapframe is mapped at TRAPFRAMESLOT(tfslot)
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
-  struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  void (*kfn)(void);           // Kernel thread's function; see kthread()
+  uint64 tracemask;            // System calls to log, 1 << SYS_ number
+  struct usage u;              // Resources used; u.stime is not kept
+  uint64 ustart;               // When p last returned to user space
+  struct usage cu;             // Used by children that were waited for
 };
@@ -0,0 +1,142 @@
+//
+// Sampling profiler, driven by the timer interrupt.
+// See prof.h.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "prof.h"
+#include "defs.h"
+
+// samples each CPU holds until read. at one sample per
+// timer interrupt, about 200 seconds' worth.
+#define NPROFSAMPLE 2048
+
+// a CPU's samples. only that CPU adds to it, from its
+// timer interrupt; prof(PROF_READ) may drain it from any.
+struct profbuf {
+  struct spinlock lock;
+  struct profsample s[NPROFSAMPLE];
+  int head;      // oldest sample
+  int n;         // number of samples
+  int dropped;   // samples lost since PROF_START, buffer full
+};
+
+static struct profbuf profbufs[NCPU];
+static int profiling;
+
+void
+profinit(void)
+{
+  struct profbuf *b;
+
+  for(b = profbufs; b < &profbufs[NCPU]; b++)
+    initlock(&b->lock, "prof");
+}
+
+// Record a sample for this CPU's timer interrupt, which
+// interrupted pc, in user mode if user is set.
+// Interrupts must be off.
+void
+profintr(int user, uint64 pc)
+{
+  struct profbuf *b;
+  struct profsample *s;
+  struct proc *p;
+
+  if(!__atomic_load_n(&profiling, __ATOMIC_ACQUIRE))
+    return;
+  b = &profbufs[cpuid()];
+  p = myproc();
+  acquire(&b->lock);
+  if(b->n == NPROFSAMPLE){
+    b->dropped++;
+  } else {
+    s = &b->s[(b->head + b->n++) % NPROFSAMPLE];
+    s->user = user;
+    s->pc = pc;
+    if(p){
+      // p->name may change under us in exec(), but it is
+      // only a hint for finding symbols.
+      s->pid = p->pid;
+      safestrcpy(s->name, p->name, sizeof(s->name));
+    } else {
+      s->pid = 0;
+      s->name[0] = 0;
+    }
+  }
+  release(&b->lock);
+}
+
+// Return the total number of samples dropped since
+// PROF_START. if clear is set, also empty every buffer.
+static int
+profdropped(int clear)
+{
+  struct profbuf *b;
+  int dropped = 0;
+
+  for(b = profbufs; b < &profbufs[NCPU]; b++){
+    acquire(&b->lock);
+    dropped += b->dropped;
+    if(clear)
+      b->head = b->n = b->dropped = 0;
+    release(&b->lock);
+  }
+  return dropped;
+}
+
+// Move up to n samples to user address addr.
+// Returns the number moved, or -1 if addr is bad.
+static int
+profread(uint64 addr, int n)
+{
+  struct profbuf *b;
+  struct profsample s;
+  int i = 0;
+
+  for(b = profbufs; b < &profbufs[NCPU]; b++){
+    while(i < n){
+      acquire(&b->lock);
+      if(b->n == 0){
+        release(&b->lock);
+        break;
+      }
+      s = b->s[b->head];
+      b->head = (b->head + 1) % NPROFSAMPLE;
+      b->n--;
+      release(&b->lock);
+      if(copyout(myproc()->pagetable, addr + i*sizeof(s), (char *)&s, sizeof(s)) < 0)
+        return -1;
+      i++;
+    }
+  }
+  return i;
+}
+
+uint64
+sys_prof(void)
+{
+  int op, n;
+  uint64 addr;
+
+  if(argint(0, &op) < 0 || argaddr(1, &addr) < 0 || argint(2, &n) < 0)
+    return -1;
+  switch(op){
+  case PROF_START:
+    profdropped(1);
+    __atomic_store_n(&profiling, 1, __ATOMIC_RELEASE);
+    return 0;
+  case PROF_STOP:
+    // the samples stay, to be read.
+    __atomic_store_n(&profiling, 0, __ATOMIC_RELEASE);
+    return profdropped(0);
+  case PROF_READ:
+    return profread(addr, n);
+  }
+  return -1;
+}
@@ -0,0 +1,18 @@
+// Sampling profiler. Both the kernel and user programs
+// use this header file.
+//
+// While sampling is on, each timer interrupt records where
+// the CPU was, in that CPU's buffer. prof(PROF_READ, buf, n)
+// removes samples from the buffers, oldest first per CPU.
+
+// prof() operations.
+#define PROF_START 0  // discard old samples and start sampling
+#define PROF_STOP  1  // stop sampling; returns samples dropped
+#define PROF_READ  2  // remove up to n samples into buf
+
+struct profsample {
+  int pid;        // process interrupted, or 0 if none
+  int user;       // 1 if in user mode, 0 if in the kernel
+  uint64 pc;      // interrupted pc
+  char name[16];  // p->name, to find the program's symbols
+};
@@ -0,0 +1,143 @@
+//
+// Batched system calls through a shared submission ring.
+// See ring.h for the layout of the ring page.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "syscall.h"
+#include "ring.h"
+#include "defs.h"
+
+// system calls that may be submitted through the ring.
+// anything that can exit, replace or resize the address
+// space, or create processes is left out.
+static char ringok[] = {
+[SYS_read]    1,
+[SYS_write]   1,
+[SYS_open]    1,
+[SYS_close]   1,
+[SYS_fstat]   1,
+[SYS_dup]     1,
+[SYS_link]    1,
+[SYS_unlink]  1,
+[SYS_mkdir]   1,
+[SYS_mknod]   1,
+[SYS_chdir]   1,
+};
+
+// Map a zeroed ring page at URING in vm's page table.
+static int
+ringmap(struct vmspace *vm)
+{
+  char *mem;
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memset(mem, 0, PGSIZE);
+  if(mappages(vm->pagetable, URING, PGSIZE, (uint64)mem,
+              PTE_R | PTE_W | PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  vm->ring = (struct ring *)mem;
+  return 0;
+}
+
+// Give fork()'s child address space nvm its own copy
+// of vm's ring. Returns 0 on success, -1 if out of memory.
+int
+ringcopy(struct vmspace *vm, struct vmspace *nvm)
+{
+  if(vm->ring == 0)
+    return 0;
+  if(ringmap(nvm) < 0)
+    return -1;
+  memmove(nvm->ring, vm->ring, PGSIZE);
+  return 0;
+}
+
+// Unmap and free vm's ring, if it has one.
+void
+ringfree(struct vmspace *vm)
+{
+  if(vm->ring == 0)
+    return;
+  uvmunmap(vm->pagetable, URING, 1, 1);
+  vm->ring = 0;
+}
+
+// Map the ring, if not already mapped, and return its
+// user address. threads sharing an address space share
+// its ring too.
+uint64
+sys_ringsetup(void)
+{
+  struct vmspace *vm = myproc()->vm;
+  int r;
+
+  acquire(&vm->lock);
+  r = vm->ring == 0 ? ringmap(vm) : 0;
+  release(&vm->lock);
+  return r < 0 ? -1 : URING;
+}
+
+// Run up to n queued submission entries, stopping early if
+// the submission ring empties or the completion ring fills.
+// Returns the number of entries run.
+uint64
+sys_ringenter(void)
+{
+  struct proc *p = myproc();
+  struct ring *r = p->vm->ring;
+  struct trapframe *tf = p->trapframe;
+  struct ringsqe sqe;
+  struct ringcqe *cqe;
+  uint64 a0, a1, a2;
+  long res;
+  int n, done, lastfd;
+
+  if(argint(0, &n) < 0 || r == 0)
+    return -1;
+
+  // each entry runs with its arguments in the trapframe, as
+  // if it had trapped by itself; restore this call's own.
+  a0 = tf->a0;
+  a1 = tf->a1;
+  a2 = tf->a2;
+
+  lastfd = -1;
+  for(done = 0; done < n && !p->killed; done++){
+    __sync_synchronize();
+    if(r->sqhead == r->sqtail || r->cqtail - r->cqhead >= NRING)
+      break;
+
+    // copy the entry, since the process may change it under us.
+    sqe = r->sq[r->sqhead % NRING];
+    tf->a0 = (sqe.flags & RING_LASTFD) ? lastfd : sqe.args[0];
+    tf->a1 = sqe.args[1];
+    tf->a2 = sqe.args[2];
+    if(sqe.num > 0 && sqe.num < NELEM(ringok) && ringok[sqe.num])
+      res = syscallrun(sqe.num);
+    else
+      res = -1;
+    if((sqe.num == SYS_open || sqe.num == SYS_dup) && res >= 0)
+      lastfd = res;
+
+    cqe = &r->cq[r->cqtail % NRING];
+    cqe->udata = sqe.udata;
+    cqe->res = res;
+    __sync_synchronize();
+    r->cqtail++;
+    r->sqhead++;
+  }
+
+  tf->a0 = a0;
+  tf->a1 = a1;
+  tf->a2 = a2;
+  return done;
+}
@@ -0,0 +1,38 @@
+// Submission and completion rings for batching system calls.
+// Both the kernel and user programs use this header file.
+//
+// ringsetup() maps one struct ring at URING, shared between the
+// process and the kernel. The process fills in submission entries
+// at sqtail, then calls ringenter(n), which runs up to n of them in
+// order, each as if it were a system call of its own, and posts a
+// completion entry for each one at cqtail.
+//
+// Only the process advances sqtail and cqhead; only the kernel
+// advances sqhead and cqtail. All four only ever increase and
+// are taken modulo NRING to index the arrays.
+
+#define NRING 64   // entries in each ring
+
+// submission entry flags.
+#define RING_LASTFD 0x1  // use the fd from this batch's last open/dup as args[0]
+
+struct ringsqe {
+  int num;          // system call number, from syscall.h
+  int flags;        // RING_*
+  uint64 args[3];   // system call arguments
+  uint64 udata;     // copied to the completion entry
+};
+
+struct ringcqe {
+  uint64 udata;     // from the submission entry
+  long res;         // system call return value
+};
+
+struct ring {
+  uint sqhead;      // next submission entry the kernel will run
+  uint sqtail;      // next free submission entry
+  uint cqhead;      // next completion entry the process will read
+  uint cqtail;      // next free completion entry
+  struct ringsqe sq[NRING];
+  struct ringcqe cq[NRING];
+};
@@ -0,0 +1,32 @@
+// resource usage, for getrusage(), procinfo() and cpuinfo().
+// times are in microseconds.
+
+// getrusage() who.
+#define RUSAGE_SELF      0  // the calling process
+#define RUSAGE_CHILDREN  1  // its children that have been waited for
+
+struct rusage {
+  uint64 utime;    // time running in user space
+  uint64 stime;    // time running in the kernel
+  uint64 nvcsw;    // voluntary context switches: sleeps
+  uint64 nivcsw;   // involuntary context switches: preemptions
+  uint64 rbytes;   // bytes read with read()
+  uint64 wbytes;   // bytes written with write()
+  uint64 rblocks;  // blocks read from disk for it
+  uint64 cycles;   // CPU clock cycles while it ran
+  uint64 instret;  // instructions retired while it ran
+};
+
+struct procinfo {
+  int pid;
+  int ppid;
+  int state;       // enum procstate, from proc.h
+  int nice;
+  char name[16];
+  struct rusage ru;
+};
+
+struct cpuinfo {
+  uint64 busy;     // time running processes
+  uint64 user;     // of which in user space
+};
@@ -0,0 +1,316 @@
+//
+// Scheduling classes and per-CPU run queues.
+//
+// scheduler() in proc.c asks schedpick() for the next proc
+// to run; everything that makes a proc RUNNABLE goes through
+// setrunnable(). a scheduling class decides the order. the
+// only one so far is the fair class, which runs the proc
+// with the least virtual run time: time actually run, scaled
+// down for procs with a lower nice value.
+//
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "riscv.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "sched.h"
+#include "ktrace.h"
+#include "defs.h"
+
+// runnable procs, one queue per CPU. an idle CPU
+// takes work from the longest queue.
+struct runq {
+  struct spinlock lock;
+  struct proc *heap;          // fair class: leftist heap on vruntime
+  int n;                      // number of procs in heap
+  uint64 minvruntime;         // no queued proc is below this; never decreases
+};
+
+static struct runq runqs[NCPU];
+
+// time CSR ticks a woken proc may run ahead of the queue,
+// so that procs that mostly sleep, like sh, get the CPU
+// promptly when they wake up.
+#define WAKEUPBONUS (CLINT_INTERVAL / 2)
+
+// weight of each nice level, -20..19. each level is
+// worth about 10% of CPU time against its neighbour.
+static const int niceweight[NICE_MAX - NICE_MIN + 1] = {
+  /* -20 */ 88761, 71755, 56483, 46273, 36291,
+  /* -15 */ 29154, 23254, 18705, 14949, 11916,
+  /* -10 */ 9548, 7620, 6100, 4904, 3906,
+  /*  -5 */ 3121, 2501, 1991, 1586, 1277,
+  /*   0 */ 1024, 820, 655, 526, 423,
+  /*   5 */ 335, 272, 215, 172, 137,
+  /*  10 */ 110, 87, 70, 56, 45,
+  /*  15 */ 36, 29, 23, 18, 15,
+};
+
+#define NICE0WEIGHT 1024
+
+// Merge the heaps rooted at a and b. the heap is linked
+// through the procs themselves, so a queue has no size limit.
+// the right spine is kept shortest, and the merge walks only
+// right spines, so it takes O(log n) steps.
+static struct proc*
+heapmerge(struct proc *a, struct proc *b)
+{
+  struct proc *t;
+
+  if(a == 0)
+    return b;
+  if(b == 0)
+    return a;
+  if(b->vruntime < a->vruntime){
+    t = a;
+    a = b;
+    b = t;
+  }
+  a->rqright = heapmerge(a->rqright, b);
+  if(a->rqleft == 0 || a->rqleft->rqrank < a->rqright->rqrank){
+    t = a->rqleft;
+    a->rqleft = a->rqright;
+    a->rqright = t;
+  }
+  a->rqrank = a->rqright ? a->rqright->rqrank + 1 : 1;
+  return a;
+}
+
+// Queue p on rq.
+static void
+fairenqueue(struct runq *rq, struct proc *p)
+{
+  p->rqleft = p->rqright = 0;
+  p->rqrank = 1;
+  rq->heap = heapmerge(rq->heap, p);
+  rq->n++;
+}
+
+// Remove and return the proc with the least vruntime, or 0.
+static struct proc*
+fairdequeue(struct runq *rq)
+{
+  struct proc *p;
+
+  if((p = rq->heap) == 0)
+    return 0;
+  rq->heap = heapmerge(p->rqleft, p->rqright);
+  rq->n--;
+  if(p->vruntime > rq->minvruntime)
+    rq->minvruntime = p->vruntime;
+  return p;
+}
+
+// Called each timer tick for p, running on rq's CPU.
+// Returns 1 if p should give way to a queued proc.
+static int
+fairtick(struct runq *rq, struct proc *p)
+{
+  uint64 min;
+
+  // keep minvruntime moving while p runs, so that
+  // procs that wake up are placed near it.
+  min = p->vruntime;
+  if(rq->heap && rq->heap->vruntime < min)
+    min = rq->heap->vruntime;
+  if(min > rq->minvruntime)
+    rq->minvruntime = min;
+  return rq->heap && p->vruntime > rq->heap->vruntime;
+}
+
+// Charge p for the time it has run since it was last
+// charged. p->lock must be held.
+static void
+fairaccount(struct proc *p)
+{
+  uint64 now, d;
+
+  now = r_time();
+  d = now - p->schedstamp;
+  p->schedstamp = now;
+  p->runtime += d;
+  p->vruntime += d * NICE0WEIGHT / niceweight[p->nice - NICE_MIN];
+}
+
+struct schedclass fairclass = {
+  "fair",
+  fairenqueue,
+  fairdequeue,
+  fairtick,
+  fairaccount,
+};
+
+// classes in the order schedpick() tries them.
+static struct schedclass *classes[] = {
+  &fairclass,
+};
+
+// Charge p, running on this CPU, for its time through
+// its class, and this CPU for the same time. the cycle
+// and instret counters belong to the CPU, not to p, so
+// charge p for their progress too.
+static void
+charge(struct proc *p)
+{
+  uint64 before = p->runtime;
+  uint64 cy, in;
+
+  p->sclass->account(p);
+  push_off();
+  mycpu()->busy += p->runtime - before;
+  cy = r_cycle();
+  in = r_instret();
+  p->u.cycles += cy - p->cyclestamp;
+  p->u.instret += in - p->instretstamp;
+  p->cyclestamp = cy;
+  p->instretstamp = in;
+  pop_off();
+}
+
+// p's vruntime moved from queue from to queue to, keeping
+// its lead or lag: vruntimes on different queues are not comparable.
+static uint64
+migrate(uint64 vruntime, struct runq *from, struct runq *to)
+{
+  long lag = vruntime - from->minvruntime;
+
+  if(lag < 0 && -lag > to->minvruntime)
+    return 0;
+  return to->minvruntime + lag;
+}
+
+// Remove and return the first proc queued on rq, or 0.
+static struct proc*
+dequeue(struct runq *rq)
+{
+  struct proc *p = 0;
+  int i;
+
+  acquire(&rq->lock);
+  for(i = 0; i < NELEM(classes) && p == 0; i++)
+    p = classes[i]->dequeue(rq);
+  release(&rq->lock);
+  return p;
+}
+
+void
+schedinit(void)
+{
+  struct runq *rq;
+
+  for(rq = runqs; rq < &runqs[NCPU]; rq++)
+    initlock(&rq->lock, "runq");
+}
+
+// Make p RUNNABLE and queue it: back on this CPU's queue
+// if p is the current proc giving up the CPU, else on this
+// CPU's queue with its vruntime brought up to date, since
+// it has been asleep or is new. p->lock must be held.
+void
+setrunnable(struct proc *p)
+{
+  struct cpu *c;
+  struct runq *rq;
+  struct proc *cur;
+  int id;
+
+  push_off();
+  c = mycpu();
+  id = cpuid();
+  rq = &runqs[id];
+  cur = c->proc;
+  if(p->state == SLEEPING)
+    ktrace(KT_SLEEP, KE_WAKEUP, p->pid, (uint64)p->chan, 0, p->name);
+  p->state = RUNNABLE;
+  if(p == cur){
+    charge(p);
+  } else {
+    if(p->rq != id)
+      p->vruntime = migrate(p->vruntime, &runqs[p->rq], rq);
+    if(rq->minvruntime > WAKEUPBONUS &&
+       p->vruntime < rq->minvruntime - WAKEUPBONUS)
+      p->vruntime = rq->minvruntime - WAKEUPBONUS;
+    // let a proc that has waited its turn run without
+    // waiting for the next timer interrupt.
+    if(cur && cur->vruntime > p->vruntime + WAKEUPBONUS)
+      c->resched = 1;
+  }
+  p->rq = id;
+  acquire(&rq->lock);
+  p->sclass->enqueue(rq, p);
+  release(&rq->lock);
+  pop_off();
+}
+
+// Remove and return the next proc for this CPU to run,
+// or 0 if there is none anywhere. called by scheduler().
+struct proc*
+schedpick(void)
+{
+  struct runq *rq, *busiest;
+  struct proc *p;
+  int id;
+
+  id = cpuid();
+  if((p = dequeue(&runqs[id])) != 0)
+    return p;
+
+  // steal from the longest queue.
+  busiest = 0;
+  for(rq = runqs; rq < &runqs[NCPU]; rq++)
+    if(rq->n > 0 && (busiest == 0 || rq->n > busiest->n))
+      busiest = rq;
+  if(busiest == 0 || (p = dequeue(busiest)) == 0)
+    return 0;
+  // p->lock isn't held, but p is on no queue and not
+  // running, so nothing else looks at its vruntime.
+  p->vruntime = migrate(p->vruntime, busiest, &runqs[id]);
+  p->rq = id;
+  return p;
+}
+
+// Note that scheduler() is about to run p, or has
+// just stopped running it. p->lock must be held.
+void
+schedswitch(struct proc *p, int in)
+{
+  if(in){
+    mycpu()->resched = 0;
+    p->schedstamp = r_time();
+    p->cyclestamp = r_cycle();
+    p->instretstamp = r_instret();
+  } else if(p->state != RUNNABLE){
+    // setrunnable() charged a yielding p before queueing
+    // it, and it may be on a queue again already.
+    charge(p);
+  }
+}
+
+// Should the current proc yield the CPU? tick is non-zero
+// if called for a timer interrupt, which charges the proc
+// for its time and compares it with the queue.
+int
+schedyield(int tick)
+{
+  struct proc *p = myproc();
+  struct runq *rq;
+  int y;
+
+  if(p == 0 || p->state != RUNNING)
+    return 0;
+  push_off();
+  y = mycpu()->resched;
+  rq = &runqs[cpuid()];
+  pop_off();
+  if(tick){
+    acquire(&p->lock);
+    charge(p);
+    acquire(&rq->lock);
+    y |= p->sclass->tick(rq, p);
+    release(&rq->lock);
+    release(&p->lock);
+  }
+  return y;
+}
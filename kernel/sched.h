@@ -0,0 +1,17 @@
+// nice values; lower runs more.
+#define NICE_MIN -20
+#define NICE_MAX  19
+
+struct runq;
+
+// A scheduling class: how the procs that use it are queued
+// and charged for CPU time. see sched.c.
+struct schedclass {
+  char *name;
+  void (*enqueue)(struct runq*, struct proc*);  // runq lock held
+  struct proc* (*dequeue)(struct runq*);        // runq lock held; 0 if none
+  int (*tick)(struct runq*, struct proc*);      // runq lock held; 1 to preempt
+  void (*account)(struct proc*);                // p->lock held
+};
+
+extern struct schedclass fairclass;
@@ -15,28 +15,82 @@ initsleeplock(struct sleeplock *lk, char *name)
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->owner = 0;
+  lk->cpu = 0;
+  lk->waiters = 0;
   lk->pid = 0;
 }
 
+// Is lk's holder still running on the CPU it took lk on?
+// read without locks, so only a hint. the holder may have
+// released lk, exited and been freed, so compare the
+// pointer but never follow it.
+static int
+ownerrunning(struct sleeplock *lk)
+{
+  struct proc *o = *(struct proc * volatile *)&lk->owner;
+  struct cpu *c = *(struct cpu * volatile *)&lk->cpu;
+
+  return o != 0 && c != 0 && *(struct proc * volatile *)&c->proc == o;
+}
+
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *p = myproc();
+  struct proc **pp;
+
   acquire(&lk->lk);
   while (lk->locked) {
-    sleep(lk, &lk->lk);
+    if(ownerrunning(lk)){
+      // the holder is running on another CPU, and locks
+      // like b->lock and ip->lock are held briefly, so
+      // spinning is cheaper than a trip through sleep().
+      release(&lk->lk);
+      while(ownerrunning(lk))
+        ;
+      acquire(&lk->lk);
+      continue;
+    }
+
+    // wait in line; releasesleep() hands lk to us.
+    p->slnext = 0;
+    for(pp = &lk->waiters; *pp; pp = &(*pp)->slnext)
+      ;
+    *pp = p;
+    while(lk->owner != p)
+      sleep(&p->slnext, &lk->lk);
+    lk->cpu = mycpu();
+    release(&lk->lk);
+    return;
   }
   lk->locked = 1;
-  lk->pid = myproc()->pid;
+  lk->owner = p;
+  lk->cpu = mycpu();
+  lk->pid = p->pid;
   release(&lk->lk);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
+  struct proc *p;
+
   acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
+  if((p = lk->waiters) != 0){
+    // pass lk straight to the first waiter, rather than
+    // waking them all to race for it.
+    lk->waiters = p->slnext;
+    lk->owner = p;
+    lk->cpu = 0;
+    lk->pid = p->pid;
+    wakeup(&p->slnext);
+  } else {
+    lk->locked = 0;
+    lk->owner = 0;
+    lk->cpu = 0;
+    lk->pid = 0;
+  }
   release(&lk->lk);
 }
 
@@ -46,10 +100,7 @@ holdingsleep(struct sleeplock *lk)
   int r;
   
   acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
+  r = lk->locked && (lk->owner == myproc());
   release(&lk->lk);
   return r;
 }
-
-
-
@@ -2,7 +2,10 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
-  
+  struct proc *owner; // Process holding lock
+  struct cpu *cpu;    // CPU owner took lk on, or 0; see ownerrunning()
+  struct proc *waiters; // Sleeping for the lock, first come first
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
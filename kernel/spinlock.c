@@ -6,14 +6,53 @@
 #include "spinlock.h"
 #include "riscv.h"
 #include "proc.h"
+#include "lockstat.h"
+#include "ktrace.h"
 #include "defs.h"
 
+// statistics for each lock name. most locks are one of many
+// alike, such as each proc's, so they are counted together.
+// each CPU counts in its own cache line, with interrupts off,
+// so busy locks don't also fight over their counters;
+// lockstats() adds them up.
+#define NLOCKCLASS 64
+
+struct lockcount {
+  uint64 nacquire;
+  uint64 ncontended;
+  uint64 spin;
+} __attribute__ ((aligned (64)));
+
+struct lockclass {
+  char *name;
+  struct lockcount cpu[NCPU];
+} lockclasses[NLOCKCLASS];
+
+// Find or make the class for locks called name. lock-free,
+// since locks are initialized before there are any to use.
+// Returns 0 if there are too many names.
+static struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *lc;
+
+  for(lc = lockclasses; lc < &lockclasses[NLOCKCLASS]; lc++){
+    if(lc->name == 0)
+      __sync_bool_compare_and_swap(&lc->name, 0, name);
+    if(strncmp(lc->name, name, LOCKNAME) == 0)
+      return lc;
+  }
+  return 0;
+}
+
 void
 initlock(struct spinlock *lk, char *name)
 {
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = lockclass(name);
 }
 
 // Acquire the lock.
@@ -21,16 +60,37 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 start, spin;
+  struct lockcount *lc = 0;
+  struct proc *p;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
+  if(lk->class)
+    lc = &lk->class->cpu[cpuid()];
 
-  // On RISC-V, sync_lock_test_and_set turns into an atomic swap:
+  // On RISC-V, sync_fetch_and_add turns into an atomic add:
   //   a5 = 1
-  //   s1 = &lk->locked
-  //   amoswap.w.aq a5, a5, (s1)
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  //   s1 = &lk->next
+  //   amoadd.w a5, a5, (s1)
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+
+  // wait for our turn. each waiter only reads lk->owner,
+  // so the cache line stays shared until release().
+  if(*(volatile uint *)&lk->owner != ticket){
+    start = r_time();
+    while(*(volatile uint *)&lk->owner != ticket)
+      ;
+    spin = r_time() - start;
+    if(lc){
+      lc->ncontended++;
+      lc->spin += spin;
+    }
+    p = mycpu()->proc;
+    ktrace(KT_LOCK, KE_LOCK, p ? p->pid : 0, (uint64)lk, spin, lk->name);
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -40,6 +100,33 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  if(lc)
+    lc->nacquire++;
+}
+
+// Acquire the lock if it is free, without spinning.
+// Returns 1 if acquired, 0 if not.
+int
+tryacquire(struct spinlock *lk)
+{
+  uint ticket;
+
+  push_off();
+  if(holding(lk))
+    panic("tryacquire");
+
+  // the lock is free if the ticket now being served is
+  // the next one to hand out; take it if so.
+  ticket = *(volatile uint *)&lk->owner;
+  if(!__sync_bool_compare_and_swap(&lk->next, ticket, ticket + 1)){
+    pop_off();
+    return 0;
+  }
+  __sync_synchronize();
+  lk->cpu = mycpu();
+  if(lk->class)
+    lk->class->cpu[cpuid()].nacquire++;
+  return 1;
 }
 
 // Release the lock.
@@ -59,14 +146,11 @@ release(struct spinlock *lk)
   // On RISC-V, this emits a fence instruction.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  // On RISC-V, sync_lock_release turns into an atomic swap:
-  //   s1 = &lk->locked
-  //   amoswap.w zero, zero, (s1)
-  __sync_lock_release(&lk->locked);
+  // Serve the next ticket. only the holder writes lk->owner,
+  // but use an atomic add, since the C standard implies that
+  // an assignment might be implemented with multiple store
+  // instructions.
+  __sync_fetch_and_add(&lk->owner, 1);
 
   pop_off();
 }
@@ -77,10 +161,37 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->owner != lk->next && lk->cpu == mycpu());
   return r;
 }
 
+// Copy statistics for up to n lock names to user address
+// addr, as struct lockstats. Returns the number copied,
+// or -1 if addr is bad.
+int
+lockstats(uint64 addr, int n)
+{
+  struct lockclass *lc;
+  struct lockstat ls;
+  int i, c;
+
+  for(i = 0, lc = lockclasses; lc < &lockclasses[NLOCKCLASS] && i < n; lc++){
+    if(lc->name == 0)
+      break;
+    memset(&ls, 0, sizeof(ls));
+    safestrcpy(ls.name, lc->name, sizeof(ls.name));
+    for(c = 0; c < NCPU; c++){
+      ls.nacquire += lc->cpu[c].nacquire;
+      ls.ncontended += lc->cpu[c].ncontended;
+      ls.spin += lc->cpu[c].spin;
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(ls), (char *)&ls, sizeof(ls)) < 0)
+      return -1;
+    i++;
+  }
+  return i;
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -1,9 +1,12 @@
 // Mutual exclusion lock.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  // ticket lock: a cpu takes the next ticket, and holds the
+  // lock when owner reaches it. waiters get it in order.
+  uint next;         // Next ticket to hand out
+  uint owner;        // Ticket now holding the lock; free if == next
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  struct lockclass *class; // Statistics for locks with this name, or 0
 };
-
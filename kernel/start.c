@@ -43,6 +43,15 @@ start()
   w_pmpaddr0(0x3fffffffffffffull);
   w_pmpcfg0(0xf);
 
+  // let supervisor mode read the time CSR, a copy of the
+  // CLINT's mtime, for the lock-free clock in trap.c,
+  // and let user mode read it too, for uclock_gettime().
+  // likewise the cycle and instret CSRs, which the
+  // scheduler charges to each process; user reads see
+  // the raw per-CPU counts.
+  w_mcounteren(r_mcounteren() | 7);
+  w_scounteren(r_scounteren() | 7);
+
   // ask for clock interrupts.
   timerinit();
 
@@ -65,7 +74,7 @@ timerinit()
   int id = r_mhartid();
 
   // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
+  int interval = CLINT_INTERVAL; // cycles; about 1/10th second in qemu.
   *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
 
   // prepare information in scratch[] for timervec.
@@ -8,4 +8,7 @@ struct stat {
   short type;  // Type of file
   short nlink; // Number of links to file
   uint64 size; // Size of file in bytes
+  uint blksize; // File system's block size
+  uint addr0;  // Disk block of the file's first block, or 0
+  uint goal;   // Where the allocator looks for its next block
 };
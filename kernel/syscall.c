@@ -5,6 +5,7 @@
 #include "spinlock.h"
 #include "proc.h"
 #include "syscall.h"
+#include "sysstat.h"
 #include "defs.h"
 
 // Fetch the uint64 at addr from the current process.
@@ -12,7 +13,7 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
+  if(addr >= p->vm->sz || addr+sizeof(uint64) > p->vm->sz)
     return -1;
   if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
@@ -104,6 +105,24 @@ extern uint64 sys_unlink(void);
 extern uint64 sys_wait(void);
 extern uint64 sys_write(void);
 extern uint64 sys_uptime(void);
+extern uint64 sys_clock_gettime(void);
+extern uint64 sys_ringsetup(void);
+extern uint64 sys_ringenter(void);
+extern uint64 sys_clone(void);
+extern uint64 sys_futex(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_waitpid(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_prof(void);
+extern uint64 sys_sysstat(void);
+extern uint64 sys_trace(void);
+extern uint64 sys_ktrace(void);
+extern uint64 sys_ktread(void);
+extern uint64 sys_getrusage(void);
+extern uint64 sys_procinfo(void);
+extern uint64 sys_cpuinfo(void);
+extern uint64 sys_bcstat(void);
+extern uint64 sys_sync(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -127,8 +146,66 @@ static uint64 (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_ringsetup] sys_ringsetup,
+[SYS_ringenter] sys_ringenter,
+[SYS_clone]   sys_clone,
+[SYS_futex]   sys_futex,
+[SYS_setpriority] sys_setpriority,
+[SYS_waitpid] sys_waitpid,
+[SYS_lockstat] sys_lockstat,
+[SYS_prof]    sys_prof,
+[SYS_sysstat] sys_sysstat,
+[SYS_trace]   sys_trace,
+[SYS_ktrace]  sys_ktrace,
+[SYS_ktread]  sys_ktread,
+[SYS_getrusage] sys_getrusage,
+[SYS_procinfo] sys_procinfo,
+[SYS_cpuinfo] sys_cpuinfo,
+[SYS_bcstat]  sys_bcstat,
+[SYS_sync]    sys_sync,
 };
 
+// names for trace output, from syscallnames.pl.
+static char *syscallnames[] = {
+#include "syscallnames.h"
+};
+
+// counts and latencies of each system call, per CPU, so
+// that CPUs don't contend for them. a CPU only updates its
+// own, with interrupts off. sys_sysstat() adds them up.
+static struct sysstat sysstats[NCPU][NELEM(syscalls)];
+
+// Run system call num, with its arguments in p's trapframe,
+// timing it for sysstat() and trace().
+static uint64
+dosyscall(struct proc *p, int num)
+{
+  struct sysstat *st;
+  uint64 start, d, r;
+  int b;
+
+  start = r_time();
+  r = syscalls[num]();
+  d = r_time() - start;
+
+  push_off();
+  st = &sysstats[cpuid()][num];
+  st->count++;
+  if((long)r < 0)
+    st->errors++;
+  st->time += d;
+  for(b = 0; (d >> b) > 1 && b < NSYSHIST-1; b++)
+    ;
+  st->hist[b]++;
+  pop_off();
+
+  if(p->tracemask & (1L << num))
+    printf("%d: syscall %s -> %d (%d us)\n", p->pid, syscallnames[num],
+           (int)r, (int)(d * 1000000 / CLINT_FREQ));
+  return r;
+}
+
 void
 syscall(void)
 {
@@ -137,10 +214,49 @@ syscall(void)
 
   num = p->trapframe->a7;
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
-    p->trapframe->a0 = syscalls[num]();
+    p->trapframe->a0 = dosyscall(p, num);
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
     p->trapframe->a0 = -1;
   }
 }
+
+// Run system call num with its arguments already in the
+// trapframe, on behalf of sys_ringenter() in ring.c.
+uint64
+syscallrun(int num)
+{
+  if(num > 0 && num < NELEM(syscalls) && syscalls[num])
+    return dosyscall(myproc(), num);
+  return -1;
+}
+
+// Copy the statistics of system calls 0..n-1, summed over
+// all CPUs, to user address addr. Returns the number of
+// system call numbers there are, or -1 if addr is bad.
+uint64
+sys_sysstat(void)
+{
+  struct sysstat st;
+  uint64 addr;
+  int i, j, c, n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  for(i = 0; i < n && i < NELEM(syscalls); i++){
+    memset(&st, 0, sizeof(st));
+    // another CPU may be updating its counts; they
+    // are each a word, so at worst one call behind.
+    for(c = 0; c < NCPU; c++){
+      st.count += sysstats[c][i].count;
+      st.errors += sysstats[c][i].errors;
+      st.time += sysstats[c][i].time;
+      for(j = 0; j < NSYSHIST; j++)
+        st.hist[j] += sysstats[c][i].hist[j];
+    }
+    if(copyout(myproc()->pagetable, addr + i*sizeof(st), (char *)&st, sizeof(st)) < 0)
+      return -1;
+  }
+  return NELEM(syscalls);
+}
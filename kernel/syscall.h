@@ -20,3 +20,21 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_clock_gettime 22
+#define SYS_ringsetup 23
+#define SYS_ringenter 24
+#define SYS_clone  25
+#define SYS_futex  26
+#define SYS_setpriority 27
+#define SYS_waitpid 28
+#define SYS_lockstat 29
+#define SYS_prof   30
+#define SYS_sysstat 31
+#define SYS_trace  32
+#define SYS_ktrace 33
+#define SYS_ktread 34
+#define SYS_getrusage 35
+#define SYS_procinfo 36
+#define SYS_cpuinfo 37
+#define SYS_bcstat 38
+#define SYS_sync   39
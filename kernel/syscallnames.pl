@@ -0,0 +1,13 @@
+#!/usr/bin/perl -w
+
+# Generate syscallnames.h from syscall.h: the entries of a
+# table of system call names indexed by number, for the
+# kernel's trace output and for user programs.
+
+print "// generated by syscallnames.pl - do not edit\n";
+
+while(<>){
+    if(/^#define\s+SYS_(\w+)\s+\d+/){
+        print "[SYS_$1] \"$1\",\n";
+    }
+}
@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "time.h"
+#include "futex.h"
 
 uint64
 sys_exit(void)
@@ -35,23 +37,60 @@ sys_wait(void)
   uint64 p;
   if(argaddr(0, &p) < 0)
     return -1;
-  return wait(p);
+  return waitpid(-1, p);
+}
+
+uint64
+sys_waitpid(void)
+{
+  int pid;
+  uint64 p;
+
+  if(argint(0, &pid) < 0 || argaddr(1, &p) < 0)
+    return -1;
+  return waitpid(pid, p);
 }
 
 uint64
 sys_sbrk(void)
 {
-  int addr;
+  uint64 addr;
   int n;
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, &addr) < 0)
     return -1;
   return addr;
 }
 
+uint64
+sys_clone(void)
+{
+  uint64 fn, arg, stack;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 || argaddr(2, &stack) < 0)
+    return -1;
+  return clone(fn, arg, stack);
+}
+
+uint64
+sys_futex(void)
+{
+  uint64 addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  switch(op){
+  case FUTEX_WAIT:
+    return futexwait(addr, val);
+  case FUTEX_WAKE:
+    return futexwake(addr, val);
+  }
+  return -1;
+}
+
 uint64
 sys_sleep(void)
 {
@@ -84,14 +123,96 @@ sys_kill(void)
 }
 
 // return how many clock tick interrupts have occurred
-// since start.
+// since start. only clockintr() writes ticks, and an
+// aligned word load is atomic, so no need for tickslock.
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  return __atomic_load_n(&ticks, __ATOMIC_RELAXED);
+}
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+uint64
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+uint64
+sys_clock_gettime(void)
+{
+  int clk;
+  uint64 addr, ns;
+  struct timespec ts;
+
+  if(argint(0, &clk) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  if(clk != CLOCK_MONOTONIC)
+    return -1;
+  ns = clocknsec();
+  ts.sec = ns / 1000000000L;
+  ts.nsec = ns % 1000000000L;
+  if(copyout(myproc()->pagetable, addr, (char *)&ts, sizeof(ts)) < 0)
+    return -1;
+  return 0;
+}
+
+uint64
+sys_lockstat(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return lockstats(addr, n);
+}
+
+// log the calling process's system calls in mask, and its
+// future children's, to the console.
+uint64
+sys_trace(void)
+{
+  uint64 mask;
+
+  if(argaddr(0, &mask) < 0)
+    return -1;
+  myproc()->tracemask = mask;
+  return 0;
+}
+
+uint64
+sys_getrusage(void)
+{
+  int who;
+  uint64 addr;
+
+  if(argint(0, &who) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  return getrusage(who, addr);
+}
+
+uint64
+sys_procinfo(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return procinfo(addr, n);
+}
+
+uint64
+sys_cpuinfo(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return cpuinfo(addr, n);
 }
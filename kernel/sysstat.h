@@ -0,0 +1,10 @@
+// system call statistics, reported by sysstat(), one
+// struct per system call number.
+#define NSYSHIST 32
+
+struct sysstat {
+  uint64 count;           // calls
+  uint64 errors;          // calls that returned a negative value
+  uint64 time;            // time CSR ticks spent in all calls
+  uint64 hist[NSYSHIST];  // hist[i]: calls of 2^i to 2^(i+1) ticks; hist[0] has 0 too
+};
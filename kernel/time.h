@@ -0,0 +1,7 @@
+// clocks for clock_gettime().
+#define CLOCK_MONOTONIC 1  // time since boot, from the time CSR
+
+struct timespec {
+  uint64 sec;   // seconds
+  uint64 nsec;  // nanoseconds, less than one second
+};
@@ -4,6 +4,7 @@
 #include "riscv.h"
 #include "spinlock.h"
 #include "proc.h"
+#include "ktrace.h"
 #include "defs.h"
 
 struct spinlock tickslock;
@@ -45,7 +46,15 @@ usertrap(void)
   // since we're now in the kernel.
   w_stvec((uint64)kernelvec);
 
+  // uservec flushed the TLB; see tlbshootdown().
+  mycpu()->tlbgen++;
+
   struct proc *p = myproc();
+
+  // charge the time since usertrapret() to user space.
+  uint64 d = r_time() - p->ustart;
+  p->u.utime += d;
+  mycpu()->utime += d;
   
   // save user program counter.
   p->trapframe->epc = r_sepc();
@@ -68,16 +77,21 @@ usertrap(void)
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
+    ktrace(KT_FAULT, KE_FAULT, p->pid, r_scause(), r_stval(), p->name);
     printf("usertrap(): unexpected scause %p pid=%d\n", r_scause(), p->pid);
     printf("            sepc=%p stval=%p\n", r_sepc(), r_stval());
     p->killed = 1;
   }
 
+  if(which_dev == 2)
+    profintr(1, p->trapframe->epc);
+
   if(p->killed)
     exit(-1);
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2)
+  // give up the CPU if this timer interrupt ends the time
+  // slice, or a woken process should run first.
+  if(schedyield(which_dev == 2))
     yield();
 
   usertrapret();
@@ -121,11 +135,17 @@ usertrapret(void)
   // tell trampoline.S the user page table to switch to.
   uint64 satp = MAKE_SATP(p->pagetable);
 
+  // userret will flush the TLB; see tlbshootdown().
+  // p->vm changes in exec().
+  mycpu()->vm = p->vm;
+  mycpu()->tlbgen++;
+  p->ustart = r_time();
+
   // jump to trampoline.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with sret.
   uint64 fn = TRAMPOLINE + (userret - trampoline);
-  ((void (*)(uint64,uint64))fn)(TRAPFRAME, satp);
+  ((void (*)(uint64,uint64))fn)(TRAPFRAMESLOT(p->tfslot), satp);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -149,8 +169,12 @@ kerneltrap()
     panic("kerneltrap");
   }
 
-  // give up the CPU if this is a timer interrupt.
-  if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
+  if(which_dev == 2)
+    profintr(0, sepc);
+
+  // give up the CPU if this timer interrupt ends the time
+  // slice, or a woken process should run first.
+  if(schedyield(which_dev == 2))
     yield();
 
   // the yield() may have caused some traps to occur,
@@ -159,13 +183,32 @@ kerneltrap()
   w_sstatus(sstatus);
 }
 
+// every hart counts its own timer interrupts;
+// only hart 0 advances the global ticks that
+// sys_sleep() waits on.
 void
 clockintr()
 {
-  acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
-  release(&tickslock);
+  mycpu()->ticks++;
+
+  if(cpuid() == 0){
+    acquire(&tickslock);
+    ticks++;
+    wakeup(&ticks);
+    release(&tickslock);
+  }
+}
+
+// nanoseconds since boot, from the time CSR.
+// needs no lock, so readers never contend with
+// each other or with clockintr().
+uint64
+clocknsec(void)
+{
+  uint64 t = r_time();
+
+  return (t / CLINT_FREQ) * 1000000000L +
+         (t % CLINT_FREQ) * (1000000000L / CLINT_FREQ);
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -204,10 +247,8 @@ devintr()
     // software interrupt from a machine-mode timer interrupt,
     // forwarded by timervec in kernelvec.S.
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
+    clockintr();
+
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
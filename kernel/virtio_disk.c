@@ -16,6 +16,8 @@
 #include "fs.h"
 #include "buf.h"
 #include "virtio.h"
+#include "proc.h"
+#include "ktrace.h"
 
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
@@ -267,6 +269,7 @@ virtio_disk_rw(struct buf *b, int write)
   __sync_synchronize();
 
   *R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+  ktrace(KT_DISK, KE_DISKSUBMIT, myproc()->pid, b->blockno, write, 0);
 
   // Wait for virtio_disk_intr() to say request has finished.
   while(b->disk == 1) {
@@ -306,6 +309,7 @@ virtio_disk_intr()
 
     struct buf *b = disk.info[id].b;
     b->disk = 0;   // disk is done with buf
+    ktrace(KT_DISK, KE_DISKDONE, 0, b->blockno, 0, 0);
     wakeup(b);
 
     disk.used_idx += 1;
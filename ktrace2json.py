@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+#
+# Turn the KT lines that xv6's ktrace prints into a trace in the
+# Chrome trace event format, for chrome://tracing or Perfetto:
+#
+#   make qemu | tee console.log      (then run "ktrace 63 cmd" in xv6)
+#   ./ktrace2json.py console.log > trace.json
+#
+# Each CPU is a thread of one "xv6" process. Processes running
+# on a CPU are slices; disk requests are async slices; the other
+# events are instants.
+#
+# The last field, a process or lock name, may contain spaces.
+# python3 -m doctest ktrace2json.py checks the examples below.
+
+import json
+import sys
+
+CLINT_FREQ = 10000000  # time CSR ticks per second, from memlayout.h
+
+KE_SWITCHIN, KE_SWITCHOUT, KE_SLEEP, KE_WAKEUP, KE_BHIT, KE_BMISS, \
+    KE_DISKSUBMIT, KE_DISKDONE, KE_FAULT, KE_LOCK, KE_LOST = range(1, 12)
+
+NAMES = {
+    KE_SLEEP: "sleep",
+    KE_WAKEUP: "wakeup",
+    KE_BHIT: "bread hit",
+    KE_BMISS: "bread miss",
+    KE_FAULT: "fault",
+    KE_LOCK: "lock spin",
+    KE_LOST: "events lost",
+}
+
+
+def usec(t):
+    return t * 1000000.0 / CLINT_FREQ
+
+
+def convert(lines):
+    """
+    >>> ev = convert(["KT 0x0000000000989680 1 3 10 0x0000000080012345 "
+    ...               "0x0000000000002710 sleep lock\\n"])["traceEvents"][0]
+    >>> ev["name"], ev["ts"], ev["dur"], ev["args"]["lock"]
+    ('spin sleep lock', 999000.0, 1000.0, '0x80012345')
+    >>> convert(["KT 0x1 0 1 1 0x0 0x0\\n"])["traceEvents"][:1]
+    [{'ph': 'M', 'pid': 0, 'name': 'process_name', 'args': {'name': 'xv6'}}]
+    """
+    out = []
+    cpus = set()
+    for line in lines:
+        f = line.split(None, 7)
+        if len(f) != 8 or f[0] != "KT":
+            continue
+        f[7] = f[7].rstrip("\n")
+        t, cpu, pid, typ = int(f[1], 16), int(f[2]), int(f[3]), int(f[4])
+        a0, a1, name = int(f[5], 16), int(f[6], 16), f[7]
+        cpus.add(cpu)
+        ev = {"pid": 0, "tid": cpu, "ts": usec(t)}
+        if typ == KE_SWITCHIN:
+            ev.update(ph="B", name="%s %d" % (name, pid))
+        elif typ == KE_SWITCHOUT:
+            ev.update(ph="E")
+        elif typ in (KE_DISKSUBMIT, KE_DISKDONE):
+            ev.update(ph="b" if typ == KE_DISKSUBMIT else "e", cat="disk",
+                      name="disk", id=a0, args={"block": a0})
+            if typ == KE_DISKSUBMIT:
+                ev["args"]["write"] = a1
+        elif typ == KE_LOCK:
+            # the spin ended at t.
+            ev.update(ph="X", name="spin %s" % name, ts=usec(t - a1),
+                      dur=usec(a1), args={"pid": pid, "lock": hex(a0)})
+        elif typ in NAMES:
+            ev.update(ph="i", s="t", name=NAMES[typ],
+                      args={"pid": pid, "name": name,
+                            "arg0": hex(a0), "arg1": hex(a1)})
+        else:
+            continue
+        out.append(ev)
+    for cpu in sorted(cpus):
+        out.append({"ph": "M", "pid": 0, "tid": cpu, "name": "thread_name",
+                    "args": {"name": "cpu %d" % cpu}})
+    out.append({"ph": "M", "pid": 0, "name": "process_name",
+                "args": {"name": "xv6"}})
+    return {"traceEvents": out, "displayTimeUnit": "ns"}
+
+
+def main():
+    f = open(sys.argv[1]) if len(sys.argv) > 1 else sys.stdin
+    json.dump(convert(f), sys.stdout)
+    sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -19,19 +19,31 @@
 
 // Disk layout:
 // [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// with blocks bigger than MINBSIZE, the super block is in the boot block.
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
+uint fsbsize = MINBSIZE;
+int fssize;   // Size of the file system in blocks
+int nbitmap;
+int ninodeblocks;
 int nlog = LOGSIZE;
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
 int fsfd;
 struct superblock sb;
-char zeroes[BSIZE];
+char zeroes[MAXBSIZE];
 uint freeinode = 1;
 uint freeblock;
 
+// the root directory's names, until dxwrite() writes them.
+struct ent {
+  uint inum;
+  char name[DIRSIZ+1];
+  uint hash;
+};
+struct ent ents[NINODES+2];
+int nent;
+
 
 void balloc(int);
 void wsect(uint, void*);
@@ -40,6 +52,8 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+void dxwrite(uint inum, struct ent *e, int n);
+void addent(uint inum, char *name);
 void die(const char *);
 
 // convert to intel byte order
@@ -68,17 +82,24 @@ xint(uint x)
 int
 main(int argc, char *argv[])
 {
-  int i, cc, fd;
-  uint rootino, inum, off;
-  struct dirent de;
-  char buf[BSIZE];
-  struct dinode din;
+  int i, cc, fd, start;
+  uint rootino, inum;
+  char buf[MAXBSIZE];
 
 
   static_assert(sizeof(int) == 4, "Integers must be 4 bytes!");
 
+  if(argc >= 3 && strcmp(argv[1], "-b") == 0){
+    fsbsize = atoi(argv[2]);
+    argc -= 2;
+    argv += 2;
+  }
   if(argc < 2){
-    fprintf(stderr, "Usage: mkfs fs.img files...\n");
+    fprintf(stderr, "Usage: mkfs [-b blocksize] fs.img files...\n");
+    exit(1);
+  }
+  if(BSIZE < MINBSIZE || BSIZE > MAXBSIZE || (BSIZE & (BSIZE - 1))){
+    fprintf(stderr, "mkfs: block size must be 1024, 2048 or 4096\n");
     exit(1);
   }
 
@@ -89,49 +110,51 @@ main(int argc, char *argv[])
   if(fsfd < 0)
     die(argv[1]);
 
-  // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
-  nblocks = FSSIZE - nmeta;
+  // 1 fs block = BSIZE/512 disk sectors; the image is
+  // FSSIZE*MINBSIZE bytes whatever the block size.
+  fssize = FSSIZE * MINBSIZE / BSIZE;
+  nbitmap = fssize/(BSIZE*8) + 1;
+  ninodeblocks = NINODES / IPB + 1;
+  start = SBEND(BSIZE);
+  nmeta = start + nlog + ninodeblocks + nbitmap;
+  nblocks = fssize - nmeta;
 
   sb.magic = FSMAGIC;
-  sb.size = xint(FSSIZE);
+  sb.size = xint(fssize);
   sb.nblocks = xint(nblocks);
   sb.ninodes = xint(NINODES);
   sb.nlog = xint(nlog);
-  sb.logstart = xint(2);
-  sb.inodestart = xint(2+nlog);
-  sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.logstart = xint(start);
+  sb.inodestart = xint(start+nlog);
+  sb.bmapstart = xint(start+nlog+ninodeblocks);
+  sb.features = xint(FS_EXTENTS|FS_HASHDIR);
+  sb.bsize = xint(BSIZE);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d of %d bytes\n",
+         nmeta, nlog, ninodeblocks, nbitmap, nblocks, fssize, BSIZE);
 
   freeblock = nmeta;     // the first free block that we can allocate
 
-  for(i = 0; i < FSSIZE; i++)
+  for(i = 0; i < fssize; i++)
     wsect(i, zeroes);
 
   memset(buf, 0, sizeof(buf));
-  memmove(buf, &sb, sizeof(sb));
-  wsect(1, buf);
+  memmove(buf + MINBSIZE % BSIZE, &sb, sizeof(sb));
+  wsect(MINBSIZE / BSIZE, buf);
 
   rootino = ialloc(T_DIR);
   assert(rootino == ROOTINO);
 
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
-
-  bzero(&de, sizeof(de));
-  de.inum = xshort(rootino);
-  strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  addent(rootino, ".");
+  addent(rootino, "..");
 
   for(i = 2; i < argc; i++){
-    // get rid of "user/"
+    // get rid of "user/" or "kernel/"
     char *shortname;
     if(strncmp(argv[i], "user/", 5) == 0)
       shortname = argv[i] + 5;
+    else if(strncmp(argv[i], "kernel/", 7) == 0)
+      shortname = argv[i] + 7;
     else
       shortname = argv[i];
     
@@ -149,10 +172,7 @@ main(int argc, char *argv[])
 
     inum = ialloc(T_FILE);
 
-    bzero(&de, sizeof(de));
-    de.inum = xshort(inum);
-    strncpy(de.name, shortname, DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    addent(inum, shortname);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -160,12 +180,7 @@ main(int argc, char *argv[])
     close(fd);
   }
 
-  // fix size of root inode dir
-  rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  dxwrite(rootino, ents, nent);
 
   balloc(freeblock);
 
@@ -184,7 +199,7 @@ wsect(uint sec, void *buf)
 void
 winode(uint inum, struct dinode *ip)
 {
-  char buf[BSIZE];
+  char buf[MAXBSIZE];
   uint bn;
   struct dinode *dip;
 
@@ -198,7 +213,7 @@ winode(uint inum, struct dinode *ip)
 void
 rinode(uint inum, struct dinode *ip)
 {
-  char buf[BSIZE];
+  char buf[MAXBSIZE];
   uint bn;
   struct dinode *dip;
 
@@ -234,7 +249,7 @@ ialloc(ushort type)
 void
 balloc(int used)
 {
-  uchar buf[BSIZE];
+  uchar buf[MAXBSIZE];
   int i;
 
   printf("balloc: first %d blocks have been allocated\n", used);
@@ -249,14 +264,91 @@ balloc(int used)
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return the block holding block fbn of din's file,
+// appending a new block if fbn is just past the end.
+uint
+xmap(struct dinode *din, uint fbn)
+{
+  struct extent *e;
+  struct xblock xb;
+  uint lbn, b, nb;
+  int i;
+
+  // the blocks in the file so far.
+  lbn = 0;
+  for(i = 0; i < NEXTENT; i++){
+    e = &din->ext[i];
+    if(fbn - lbn < xint(e->len))
+      return xint(e->start) + fbn - lbn;
+    lbn += xint(e->len);
+  }
+  for(b = xint(din->xhead); b; b = xint(xb.next)){
+    rsect(b, &xb);
+    for(i = 0; i < xint(xb.n); i++){
+      e = &xb.ext[i];
+      if(fbn - lbn < xint(e->len))
+        return xint(e->start) + fbn - lbn;
+      lbn += xint(e->len);
+    }
+  }
+  assert(fbn == lbn);
+
+  // a new block, which usually extends the last extent.
+  nb = freeblock++;
+  din->nblocks = xint(xint(din->nblocks) + 1);
+  if(din->xtail == 0){
+    for(i = NEXTENT; i > 0 && din->ext[i-1].len == 0; i--)
+      ;
+    if(i > 0 && xint(din->ext[i-1].start) + xint(din->ext[i-1].len) == nb){
+      din->ext[i-1].len = xint(xint(din->ext[i-1].len) + 1);
+      return nb;
+    }
+    if(i < NEXTENT){
+      din->ext[i].start = xint(nb);
+      din->ext[i].len = xint(1);
+      return nb;
+    }
+  } else {
+    rsect(xint(din->xtail), &xb);
+    e = &xb.ext[xint(xb.n)-1];
+    if(xint(e->start) + xint(e->len) == nb){
+      e->len = xint(xint(e->len) + 1);
+      wsect(xint(din->xtail), &xb);
+      return nb;
+    }
+    if(xint(xb.n) < NXEXTENT){
+      xb.ext[xint(xb.n)].start = xint(nb);
+      xb.ext[xint(xb.n)].len = xint(1);
+      xb.n = xint(xint(xb.n) + 1);
+      wsect(xint(din->xtail), &xb);
+      return nb;
+    }
+  }
+
+  // start another extent block, after nb.
+  b = freeblock++;
+  if(din->xtail){
+    xb.next = xint(b);
+    wsect(xint(din->xtail), &xb);
+  } else {
+    din->xhead = xint(b);
+  }
+  din->xtail = xint(b);
+  bzero(&xb, sizeof(xb));
+  xb.n = xint(1);
+  xb.ext[0].start = xint(nb);
+  xb.ext[0].len = xint(1);
+  wsect(b, &xb);
+  return nb;
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
   char *p = (char*)xp;
   uint fbn, off, n1;
   struct dinode din;
-  char buf[BSIZE];
-  uint indirect[NINDIRECT];
+  char buf[MAXBSIZE];
   uint x;
 
   rinode(inum, &din);
@@ -264,23 +356,7 @@ iappend(uint inum, void *xp, int n)
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = xmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -299,3 +375,86 @@ die(const char *s)
   perror(s);
   exit(1);
 }
+
+void
+addent(uint inum, char *name)
+{
+  assert(nent < sizeof(ents)/sizeof(ents[0]));
+  ents[nent].inum = inum;
+  strncpy(ents[nent].name, name, DIRSIZ);
+  nent++;
+}
+
+// as dxhash() in kernel/fs.c.
+uint
+dxhash(char *name, int len)
+{
+  uint h = 2166136261U;
+  int i;
+
+  for(i = 0; i < len; i++){
+    h ^= (uchar)name[i];
+    h *= 16777619;
+  }
+  return h;
+}
+
+int
+hashcmp(const void *a, const void *b)
+{
+  uint x = ((struct ent*)a)->hash, y = ((struct ent*)b)->hash;
+
+  return x < y ? -1 : x > y;
+}
+
+// Write the hashed directory inum, holding the n names in e:
+// the index block, then leaves filled in hash order.
+void
+dxwrite(uint inum, struct ent *e, int n)
+{
+  static char leaves[NDXINDEXS(MAXBSIZE)][MAXBSIZE];
+  char buf[MAXBSIZE];
+  struct dxroot *r = (struct dxroot*)buf;
+  struct dxleaf *l = 0;
+  struct dxent *de;
+  int i, nleaf, len, used;
+
+  for(i = 0; i < n; i++)
+    e[i].hash = dxhash(e[i].name, strlen(e[i].name));
+  qsort(e, n, sizeof(e[0]), hashcmp);
+
+  bzero(buf, sizeof(buf));
+  bzero(leaves, sizeof(leaves));
+  nleaf = 0;
+  used = BSIZE;
+  for(i = 0; i < n; i++){
+    len = strlen(e[i].name);
+    if(used + DXRECLEN(len) > BSIZE){
+      // names with the same hash must share a leaf.
+      if(i > 0 && e[i].hash == e[i-1].hash)
+        die("dxwrite: hash");
+      if(nleaf == NDXINDEX)
+        die("dxwrite: too many names");
+      if(l)
+        l->used = xshort(used);
+      r->idx[nleaf].hash = xint(nleaf == 0 ? 0 : e[i].hash);
+      r->idx[nleaf].block = xint(nleaf + 1);
+      l = (struct dxleaf*)leaves[nleaf++];
+      used = sizeof(*l);
+    }
+    de = (struct dxent*)(leaves[nleaf-1] + used);
+    de->inum = xint(e[i].inum);
+    de->namelen = len;
+    memmove(de->name, e[i].name, len);
+    used += DXRECLEN(len);
+    l->n = xshort(xshort(l->n) + 1);
+  }
+  l->used = xshort(used);
+  r->magic = xint(DXMAGIC);
+  r->nentries = xint(n);
+  r->nleaf = xint(nleaf);
+
+  iappend(inum, buf, BSIZE);
+  for(i = 0; i < nleaf; i++)
+    iappend(inum, leaves[i], BSIZE);
+}
@@ -0,0 +1,75 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/bcstat.h"
+#include "user/user.h"
+
+// print the buffer and page caches' counters and the free
+// blocks: bcstat alone for the totals since boot, or bcstat
+// command [args...] for how they changed while it ran.
+
+void
+print(struct bcstat *st, struct bcstat *old, struct bcstat *now)
+{
+  uint64 n;
+  int g;
+
+  printf("buffer cache: %d hits, %d misses", (int)st->hits, (int)st->misses);
+  n = st->hits + st->misses;
+  if(n > 0)
+    printf(" (%d%% hits)", (int)(st->hits * 100 / n));
+  printf("\n%d evictions\n", (int)st->evictions);
+  printf("%d buffers", (int)now->nbuf);
+  if(old)
+    printf(" (%d before)", (int)old->nbuf);
+  printf(", %d pages added, %d given back\n", (int)st->grows, (int)st->shrinks);
+  printf("page cache: %d hits, %d misses", (int)st->phits, (int)st->pmisses);
+  n = st->phits + st->pmisses;
+  if(n > 0)
+    printf(" (%d%% hits)", (int)(st->phits * 100 / n));
+  printf(", %d pages, %d dirty\n", (int)now->npage, (int)now->ndirty);
+  printf("%d file blocks written back\n", (int)st->pwrites);
+  n = 0;
+  for(g = 0; g < now->ngroup && g < NBCGROUP; g++)
+    n += now->gfree[g];
+  printf("%d free blocks in %d groups\n", (int)n, (int)now->ngroup);
+}
+
+int
+main(int argc, char **argv)
+{
+  struct bcstat before, after, d;
+  int pid;
+
+  if(bcstat(&before) < 0){
+    fprintf(2, "bcstat: bcstat failed\n");
+    exit(1);
+  }
+  if(argc < 2){
+    print(&before, 0, &before);
+    exit(0);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "bcstat: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "bcstat: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  waitpid(pid, 0);
+  bcstat(&after);
+
+  d.hits = after.hits - before.hits;
+  d.misses = after.misses - before.misses;
+  d.evictions = after.evictions - before.evictions;
+  d.grows = after.grows - before.grows;
+  d.shrinks = after.shrinks - before.shrinks;
+  d.phits = after.phits - before.phits;
+  d.pmisses = after.pmisses - before.pmisses;
+  d.pwrites = after.pwrites - before.pwrites;
+  print(&d, &before, &after);
+  exit(0);
+}
@@ -1,16 +1,73 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/syscall.h"
+#include "kernel/ring.h"
 #include "user/user.h"
 
-char buf[512];
+#define NBATCH 8
+
+char buf[NBATCH][512];
+
+// cat a regular file through the submission ring: queue
+// NBATCH reads, then write out what they returned along
+// with the next NBATCH reads, one trap per batch.
+int
+ringcat(int fd)
+{
+  struct ringcqe c;
+  int i, n[NBATCH], w[NBATCH], eof;
+
+  eof = 0;
+  for(i = 0; i < NBATCH; i++)
+    ringsubmit(SYS_read, fd, (uint64)buf[i], sizeof(buf[i]), 0, i);
+  while(ringflush() > 0){
+    for(i = 0; i < NBATCH; i++)
+      n[i] = 0;
+    while(ringreap(&c)){
+      if(c.udata < NBATCH){
+        if(c.res < 0)
+          return -1;
+        n[c.udata] = c.res;
+        if(c.res < sizeof(buf[0]))
+          eof = 1;
+      } else if(c.res != w[c.udata - NBATCH]){
+        fprintf(2, "cat: write error\n");
+        exit(1);
+      }
+    }
+
+    // the writes run before the reads that reuse their buffers.
+    for(i = 0; i < NBATCH; i++){
+      if(n[i] > 0){
+        w[i] = n[i];
+        ringsubmit(SYS_write, 1, (uint64)buf[i], w[i], 0, NBATCH + i);
+      }
+    }
+    if(!eof){
+      for(i = 0; i < NBATCH; i++)
+        ringsubmit(SYS_read, fd, (uint64)buf[i], sizeof(buf[i]), 0, i);
+    }
+  }
+  return 0;
+}
 
 void
 cat(int fd)
 {
   int n;
+  struct stat st;
+
+  // batching would hold back output from a pipe or the console.
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && ringinit() != 0){
+    if(ringcat(fd) < 0){
+      fprintf(2, "cat: read error\n");
+      exit(1);
+    }
+    return;
+  }
 
-  while((n = read(fd, buf, sizeof(buf))) > 0) {
-    if (write(1, buf, n) != n) {
+  while((n = read(fd, buf[0], sizeof(buf[0]))) > 0) {
+    if (write(1, buf[0], n) != n) {
       fprintf(2, "cat: write error\n");
       exit(1);
     }
@@ -116,7 +116,7 @@ find(char *path, char *re){
             p[DIRSIZ] = 0;
 
             // 获取当前路径的状态信息
-            if (stat(buf, &st) < 0) {
+            if (ringstat(buf, &st) < 0) {
                 printf("find: cannot stat %s\n", buf);
                 continue;
             }
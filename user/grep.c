@@ -2,11 +2,41 @@
 
 #include "kernel/types.h"
 #include "kernel/stat.h"
+#include "kernel/syscall.h"
+#include "kernel/ring.h"
 #include "user/user.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// run the queued writes of matching lines.
+void
+flushlines(void)
+{
+  struct ringcqe c;
+
+  if(ringinit() == 0)
+    return;
+  ringflush();
+  while(ringreap(&c))
+    ;
+}
+
+// write a matching line. with the submission ring, the
+// lines found in one buffer go out in a single trap.
+void
+putline(char *p, int n)
+{
+  if(ringinit() == 0){
+    write(1, p, n);
+    return;
+  }
+  if(ringsubmit(SYS_write, 1, (uint64)p, n, 0, 0) < 0){
+    flushlines();
+    ringsubmit(SYS_write, 1, (uint64)p, n, 0, 0);
+  }
+}
+
 void
 grep(char *pattern, int fd)
 {
@@ -22,10 +52,11 @@ grep(char *pattern, int fd)
       *q = 0;
       if(match(pattern, p)){
         *q = '\n';
-        write(1, p, q+1 - p);
+        putline(p, q+1 - p);
       }
       p = q+1;
     }
+    flushlines();
     if(m > 0){
       m -= p - buf;
       memmove(buf, p, m);
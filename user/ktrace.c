@@ -0,0 +1,78 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/ktrace.h"
+#include "user/user.h"
+
+// run a command with the kernel event categories in mask
+// traced, printing each event as a line starting with KT.
+// ktrace2json.py turns the lines into a timeline.
+//
+// a second process prints events while the command runs,
+// since the kernel holds only about a thousand events
+// for each CPU, and drops more until they are read.
+
+#define NEV 64
+
+struct ktevent ev[NEV];
+
+void
+printer(void)
+{
+  int i, n;
+
+  for(;;){
+    if((n = ktread(ev, NEV)) < 0){
+      fprintf(2, "ktrace: ktread failed\n");
+      exit(1);
+    }
+    for(i = 0; i < n; i++)
+      printf("KT %p %d %d %d %p %p %s\n", ev[i].time, ev[i].cpu, ev[i].pid,
+             ev[i].type, ev[i].arg0, ev[i].arg1,
+             ev[i].name[0] ? ev[i].name : "-");
+    if(n == 0){
+      // main() turns tracing off when the command is
+      // done; after that, empty buffers stay empty.
+      if(ktrace(-1) == 0)
+        exit(0);
+      sleep(1);
+    }
+  }
+}
+
+int
+main(int argc, char **argv)
+{
+  int pid, ppid;
+
+  if(argc < 3){
+    fprintf(2, "usage: ktrace mask command [args...]\n");
+    exit(1);
+  }
+
+  if(ktrace(atoi(argv[1])) < 0){
+    fprintf(2, "ktrace: ktrace failed\n");
+    exit(1);
+  }
+  ppid = fork();
+  if(ppid < 0){
+    fprintf(2, "ktrace: fork failed\n");
+    exit(1);
+  }
+  if(ppid == 0)
+    printer();
+
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "ktrace: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[2], argv + 2);
+    fprintf(2, "ktrace: exec %s failed\n", argv[2]);
+    exit(1);
+  }
+  waitpid(pid, 0);
+  ktrace(0);
+  waitpid(ppid, 0);
+  exit(0);
+}
@@ -0,0 +1,64 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/lockstat.h"
+#include "user/user.h"
+
+// print spinlock statistics, most contended first: since
+// boot, or while running a command if one is given.
+
+#define NSTAT 64
+
+struct lockstat before[NSTAT], after[NSTAT];
+
+int
+main(int argc, char **argv)
+{
+  int i, j, n, m, pid;
+  struct lockstat t;
+
+  n = 0;
+  if(argc > 1){
+    if((n = lockstat(before, NSTAT)) < 0){
+      fprintf(2, "lockstat: lockstat failed\n");
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "lockstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    wait(0);
+  }
+  if((m = lockstat(after, NSTAT)) < 0){
+    fprintf(2, "lockstat: lockstat failed\n");
+    exit(1);
+  }
+
+  // names are never removed, so before[i] is after[i].
+  for(i = 0; i < n; i++){
+    after[i].nacquire -= before[i].nacquire;
+    after[i].ncontended -= before[i].ncontended;
+    after[i].spin -= before[i].spin;
+  }
+
+  for(i = 1; i < m; i++){
+    t = after[i];
+    for(j = i; j > 0 && after[j-1].ncontended < t.ncontended; j--)
+      after[j] = after[j-1];
+    after[j] = t;
+  }
+
+  printf("%s\t%s\t%s\t%s\n", "name", "acquire", "contend", "spin");
+  for(i = 0; i < m; i++){
+    if(after[i].nacquire == 0)
+      continue;
+    printf("%s\t%l\t%l\t%l\n", after[i].name, after[i].nacquire,
+           after[i].ncontended, after[i].spin);
+  }
+  exit(0);
+}
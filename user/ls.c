@@ -3,6 +3,9 @@
 #include "user/user.h"
 #include "kernel/fs.h"
 
+// names are padded to this many columns.
+#define NAMECOL 14
+
 char*
 fmtname(char *path)
 {
@@ -15,10 +18,11 @@ fmtname(char *path)
   p++;
 
   // Return blank-padded name.
-  if(strlen(p) >= DIRSIZ)
+  if(strlen(p) >= NAMECOL)
     return p;
   memmove(buf, p, strlen(p));
-  memset(buf+strlen(p), ' ', DIRSIZ-strlen(p));
+  memset(buf+strlen(p), ' ', NAMECOL-strlen(p));
+  buf[NAMECOL] = 0;
   return buf;
 }
 
@@ -0,0 +1,50 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+// run a command and print the cycles and instructions
+// it, and the children it waited for, used: counted only
+// while they were running, so other processes don't count.
+
+int
+main(int argc, char **argv)
+{
+  struct rusage before, after;
+  uint64 cycles, instret;
+  int pid;
+
+  if(argc < 2){
+    fprintf(2, "usage: perf command [args...]\n");
+    exit(1);
+  }
+
+  if(getrusage(RUSAGE_CHILDREN, &before) < 0){
+    fprintf(2, "perf: getrusage failed\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "perf: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "perf: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  waitpid(pid, 0);
+  getrusage(RUSAGE_CHILDREN, &after);
+
+  cycles = after.cycles - before.cycles;
+  instret = after.instret - before.instret;
+  // printf's %l is only 32 bits, so print millions.
+  printf("%d.%d M cycles\n", (int)(cycles / 1000000), (int)(cycles / 100000 % 10));
+  printf("%d.%d M instructions\n", (int)(instret / 1000000), (int)(instret / 100000 % 10));
+  if(cycles > 0)
+    printf("%d.%d%d instructions per cycle\n", (int)(instret / cycles),
+           (int)(instret * 10 / cycles % 10), (int)(instret * 100 / cycles % 10));
+  printf("%d ms user, %d ms sys\n", (int)((after.utime - before.utime) / 1000),
+         (int)((after.stime - before.stime) / 1000));
+  exit(0);
+}
@@ -0,0 +1,217 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/param.h"
+#include "kernel/prof.h"
+#include "user/user.h"
+
+// run a command with the profiler on, then print a flat
+// profile: how many timer interrupts found each function
+// running, in the kernel or in a user program. symbols come
+// from kernel.sym and prog.sym, which the Makefile puts in
+// the file system.
+
+#define NSAMPLE (NCPU*2048)
+#define NTAB 32
+#define NENTRY 512
+
+struct sym {
+  uint64 addr;
+  char *name;
+};
+
+// the symbols of the kernel, if name is "kernel",
+// or of a user program.
+struct symtab {
+  char name[16];
+  struct sym *syms;  // sorted by addr; 0 if no .sym file
+  int n;
+};
+
+// the samples that hit one function.
+struct entry {
+  struct symtab *tab;
+  char *sym;
+  int count;
+};
+
+struct profsample samples[NSAMPLE];
+struct symtab tabs[NTAB];
+int ntab;
+struct entry entries[NENTRY];
+int nentry;
+
+uint64
+hex(char *s, char **end)
+{
+  uint64 x = 0;
+
+  for(;; s++){
+    if(*s >= '0' && *s <= '9')
+      x = x*16 + *s - '0';
+    else if(*s >= 'a' && *s <= 'f')
+      x = x*16 + *s - 'a' + 10;
+    else
+      break;
+  }
+  *end = s;
+  return x;
+}
+
+// Read the .sym file for name, a program or "kernel".
+// objdump lists sections and source files too; they have
+// a '.' in their names, so skip those.
+void
+loadsyms(struct symtab *t)
+{
+  char path[32], *buf, *s, *e, *nl;
+  struct stat st;
+  struct sym x;
+  int fd, i, j;
+
+  strcpy(path, t->name);
+  strcpy(path + strlen(path), ".sym");
+  if((fd = open(path, O_RDONLY)) < 0)
+    return;
+  if(fstat(fd, &st) < 0 || (buf = malloc(st.size + 1)) == 0){
+    close(fd);
+    return;
+  }
+  if(read(fd, buf, st.size) != st.size){
+    close(fd);
+    free(buf);
+    return;
+  }
+  close(fd);
+  buf[st.size] = 0;
+
+  // one line per symbol, so count lines for the table size.
+  for(i = 0, s = buf; *s; s++)
+    if(*s == '\n')
+      i++;
+  t->syms = malloc((i + 1) * sizeof(struct sym));
+  for(s = buf; *s; s = nl + 1){
+    if((nl = strchr(s, '\n')) == 0)
+      break;
+    *nl = 0;
+    x.addr = hex(s, &e);
+    if(*e != ' ' || strchr(e + 1, '.') != 0)
+      continue;
+    x.name = e + 1;
+    // insertion sort; the files are mostly in order already.
+    for(j = t->n; j > 0 && t->syms[j-1].addr > x.addr; j--)
+      t->syms[j] = t->syms[j-1];
+    t->syms[j] = x;
+    t->n++;
+  }
+}
+
+struct symtab*
+findtab(char *name)
+{
+  struct symtab *t;
+
+  for(t = tabs; t < &tabs[ntab]; t++)
+    if(strcmp(t->name, name) == 0)
+      return t;
+  if(ntab == NTAB)
+    return 0;
+  t = &tabs[ntab++];
+  strcpy(t->name, name);
+  loadsyms(t);
+  return t;
+}
+
+// Name of the function in t containing pc, or "?".
+char*
+findsym(struct symtab *t, uint64 pc)
+{
+  int lo, hi, mid;
+
+  if(t == 0 || t->n == 0 || pc < t->syms[0].addr)
+    return "?";
+  // the last symbol at or below pc.
+  lo = 0;
+  hi = t->n - 1;
+  while(lo < hi){
+    mid = (lo + hi + 1) / 2;
+    if(t->syms[mid].addr <= pc)
+      lo = mid;
+    else
+      hi = mid - 1;
+  }
+  return t->syms[lo].name;
+}
+
+void
+count(struct profsample *s)
+{
+  struct symtab *t;
+  struct entry *e;
+  char *sym;
+
+  s->name[sizeof(s->name)-1] = 0;
+  t = findtab(s->user ? s->name : "kernel");
+  sym = findsym(t, s->pc);
+  for(e = entries; e < &entries[nentry]; e++)
+    if(e->tab == t && strcmp(e->sym, sym) == 0)
+      break;
+  if(e == &entries[nentry]){
+    if(nentry == NENTRY)
+      return;
+    nentry++;
+    e->tab = t;
+    e->sym = sym;
+    e->count = 0;
+  }
+  e->count++;
+}
+
+int
+main(int argc, char **argv)
+{
+  int i, j, n, pid, dropped;
+  struct entry t;
+
+  if(argc < 2){
+    fprintf(2, "usage: prof command [args...]\n");
+    exit(1);
+  }
+
+  if(prof(PROF_START, 0, 0) < 0){
+    fprintf(2, "prof: cannot start profiler\n");
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    fprintf(2, "prof: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    exec(argv[1], argv + 1);
+    fprintf(2, "prof: exec %s failed\n", argv[1]);
+    exit(1);
+  }
+  waitpid(pid, 0);
+  dropped = prof(PROF_STOP, 0, 0);
+  n = prof(PROF_READ, samples, NSAMPLE);
+
+  for(i = 0; i < n; i++)
+    count(&samples[i]);
+  for(i = 1; i < nentry; i++){
+    t = entries[i];
+    for(j = i; j > 0 && entries[j-1].count < t.count; j--)
+      entries[j] = entries[j-1];
+    entries[j] = t;
+  }
+
+  printf("%d samples", n);
+  if(dropped > 0)
+    printf(", %d dropped", dropped);
+  printf("\n");
+  for(i = 0; i < nentry; i++){
+    printf("%d\t%d%%\t%s:%s\n", entries[i].count, entries[i].count * 100 / n,
+           entries[i].tab ? entries[i].tab->name : "?", entries[i].sym);
+  }
+  exit(0);
+}
@@ -0,0 +1,84 @@
+// Helpers for batching system calls through the
+// submission ring; see kernel/ring.h.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "kernel/syscall.h"
+#include "kernel/ring.h"
+#include "user/user.h"
+
+static struct ring *ring;
+
+// Map the ring on first use. Returns 0 if the kernel
+// can't, in which case callers should fall back to
+// plain system calls.
+struct ring*
+ringinit(void)
+{
+  struct ring *r;
+
+  if(ring == 0 && (r = ringsetup()) != (struct ring*)-1)
+    ring = r;
+  return ring;
+}
+
+// Queue system call num for the next ringflush().
+// Returns -1 if the submission ring is full.
+int
+ringsubmit(int num, uint64 a0, uint64 a1, uint64 a2, int flags, uint64 udata)
+{
+  struct ringsqe *e;
+
+  if(ring->sqtail - ring->sqhead >= NRING)
+    return -1;
+  e = &ring->sq[ring->sqtail % NRING];
+  e->num = num;
+  e->flags = flags;
+  e->args[0] = a0;
+  e->args[1] = a1;
+  e->args[2] = a2;
+  e->udata = udata;
+  ring->sqtail++;
+  return 0;
+}
+
+// Run everything queued, in one trap.
+// Returns the number of entries run.
+int
+ringflush(void)
+{
+  return ringenter(ring->sqtail - ring->sqhead);
+}
+
+// Take the next completion. Returns 0 if there is none.
+int
+ringreap(struct ringcqe *c)
+{
+  if(ring->cqhead == ring->cqtail)
+    return 0;
+  *c = ring->cq[ring->cqhead % NRING];
+  ring->cqhead++;
+  return 1;
+}
+
+// stat() in one trap instead of three.
+// Expects an otherwise empty ring.
+int
+ringstat(const char *n, struct stat *st)
+{
+  struct ringcqe c;
+  int r;
+
+  if(ringinit() == 0)
+    return stat(n, st);
+  ringsubmit(SYS_open, (uint64)n, O_RDONLY, 0, 0, 0);
+  ringsubmit(SYS_fstat, 0, (uint64)st, 0, RING_LASTFD, 1);
+  ringsubmit(SYS_close, 0, 0, 0, RING_LASTFD, 2);
+  ringflush();
+  r = -1;
+  while(ringreap(&c))
+    if(c.udata == 1)
+      r = c.res;
+  return r;
+}
@@ -0,0 +1,98 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/stat.h"
+#include "kernel/memlayout.h"
+#include "kernel/syscall.h"
+#include "kernel/sysstat.h"
+#include "user/user.h"
+
+// print system call counts, errors and mean latency since
+// boot, or while running a command if one is given. with
+// -h, print each call's latency histogram too.
+
+#define NSTAT 64
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+char *names[] = {
+#include "kernel/syscallnames.h"
+};
+
+struct sysstat before[NSTAT], after[NSTAT];
+
+// time CSR ticks to microseconds.
+int
+usec(uint64 t)
+{
+  return t * 1000000 / CLINT_FREQ;
+}
+
+// print a time, in ns if less than a microsecond.
+void
+printtime(uint64 t)
+{
+  if(usec(t) == 0)
+    printf("%d ns", (int)(t * 1000000000 / CLINT_FREQ));
+  else
+    printf("%d us", usec(t));
+}
+
+int
+main(int argc, char **argv)
+{
+  int i, j, n, pid, hist;
+
+  hist = 0;
+  if(argc > 1 && strcmp(argv[1], "-h") == 0){
+    hist = 1;
+    argc--;
+    argv++;
+  }
+
+  memset(before, 0, sizeof(before));
+  if(argc > 1){
+    if(sysstat(before, NSTAT) < 0){
+      fprintf(2, "sysstat: sysstat failed\n");
+      exit(1);
+    }
+    pid = fork();
+    if(pid < 0){
+      fprintf(2, "sysstat: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      exec(argv[1], argv + 1);
+      fprintf(2, "sysstat: exec %s failed\n", argv[1]);
+      exit(1);
+    }
+    waitpid(pid, 0);
+  }
+  if((n = sysstat(after, NSTAT)) < 0){
+    fprintf(2, "sysstat: sysstat failed\n");
+    exit(1);
+  }
+  if(n > NSTAT)
+    n = NSTAT;
+
+  printf("%s\t%s\t%s\t%s\n", "call", "count", "errors", "mean us");
+  for(i = 1; i < n; i++){
+    after[i].count -= before[i].count;
+    after[i].errors -= before[i].errors;
+    after[i].time -= before[i].time;
+    for(j = 0; j < NSYSHIST; j++)
+      after[i].hist[j] -= before[i].hist[j];
+    if(after[i].count == 0)
+      continue;
+    printf("%s\t%d\t%d\t%d\n", i < NELEM(names) && names[i] ? names[i] : "?",
+           (int)after[i].count, (int)after[i].errors,
+           usec(after[i].time / after[i].count));
+    if(hist){
+      for(j = 0; j < NSYSHIST; j++)
+        if(after[i].hist[j]){
+          printf("\t< ");
+          printtime(2L << j);
+          printf("\t%d\n", (int)after[i].hist[j]);
+        }
+    }
+  }
+  exit(0);
+}
@@ -0,0 +1,101 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/param.h"
+#include "kernel/time.h"
+#include "kernel/rusage.h"
+#include "user/user.h"
+
+// show the busiest processes, and how busy each CPU is,
+// once a second: top [count], for count refreshes.
+
+#define NPI 256
+
+struct procinfo pi0[NPI], pi1[NPI];
+struct cpuinfo ci0[NCPU], ci1[NCPU];
+int order[NPI];
+
+char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+uint64
+now(void)
+{
+  struct timespec ts;
+
+  uclock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.sec * 1000000 + ts.nsec / 1000;
+}
+
+// CPU time p used since the last snapshot, in microseconds.
+uint64
+used(struct procinfo *p, struct procinfo *old, int nold)
+{
+  uint64 t = p->ru.utime + p->ru.stime;
+  int i;
+
+  for(i = 0; i < nold; i++)
+    if(old[i].pid == p->pid)
+      return t - (old[i].ru.utime + old[i].ru.stime);
+  return t;
+}
+
+int
+main(int argc, char **argv)
+{
+  int count, i, j, n0, n1, c0, c1, t;
+  uint64 t0, t1, dt, u[NPI];
+  struct procinfo *p;
+
+  count = argc > 1 ? atoi(argv[1]) : 10;
+  n0 = procinfo(pi0, NPI);
+  c0 = cpuinfo(ci0, NCPU);
+  t0 = now();
+  while(count-- > 0){
+    sleep(10);
+    n1 = procinfo(pi1, NPI);
+    c1 = cpuinfo(ci1, NCPU);
+    t1 = now();
+    if(n0 < 0 || n1 < 0 || c0 < 0 || c1 < 0){
+      fprintf(2, "top: procinfo failed\n");
+      exit(1);
+    }
+    dt = t1 - t0;
+    if(dt == 0)
+      dt = 1;
+
+    // clear the screen.
+    printf("\033[H\033[J");
+    for(i = 0; i < c1; i++){
+      uint64 busy = ci1[i].busy - (i < c0 ? ci0[i].busy : 0);
+      uint64 user = ci1[i].user - (i < c0 ? ci0[i].user : 0);
+      printf("cpu%d: %d%% busy, %d%% user\n", i,
+             (int)(busy * 100 / dt), (int)(user * 100 / dt));
+    }
+
+    for(i = 0; i < n1; i++){
+      u[i] = used(&pi1[i], pi0, n0);
+      for(j = i; j > 0 && u[order[j-1]] < u[i]; j--)
+        order[j] = order[j-1];
+      order[j] = i;
+    }
+    printf("\n%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\t%s\n",
+           "pid", "ppid", "state", "nice", "%cpu", "user ms", "sys ms",
+           "vcsw", "ivcsw", "blocks", "name");
+    for(i = 0; i < n1; i++){
+      p = &pi1[order[i]];
+      t = p->state >= 0 && p->state < 6 ? p->state : 0;
+      printf("%d\t%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%s\n",
+             p->pid, p->ppid, states[t], p->nice,
+             (int)(u[order[i]] * 100 / dt),
+             (int)(p->ru.utime / 1000), (int)(p->ru.stime / 1000),
+             (int)p->ru.nvcsw, (int)p->ru.nivcsw, (int)p->ru.rblocks,
+             p->name);
+    }
+
+    memmove(pi0, pi1, n1 * sizeof(pi1[0]));
+    memmove(ci0, ci1, c1 * sizeof(ci1[0]));
+    n0 = n1;
+    c0 = c1;
+    t0 = t1;
+  }
+  exit(0);
+}
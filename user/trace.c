@@ -0,0 +1,93 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/syscall.h"
+#include "user/user.h"
+
+// run a command, logging each system call in mask, with its
+// result and how long it took. mask is a number, with bit
+// 1 << SYS_ number set for each call, or a comma-separated
+// list of call names.
+
+#define NELEM(x) (sizeof(x)/sizeof((x)[0]))
+
+char *names[] = {
+#include "kernel/syscallnames.h"
+};
+
+// parse a decimal or 0x hex number into *mask.
+int
+parsenum(char *s, uint64 *mask)
+{
+  uint64 m = 0;
+  int base = 10, d;
+
+  if(s[0] == '0' && s[1] == 'x'){
+    base = 16;
+    s += 2;
+  }
+  if(*s == 0)
+    return -1;
+  for(; *s; s++){
+    if(*s >= '0' && *s <= '9')
+      d = *s - '0';
+    else if(base == 16 && *s >= 'a' && *s <= 'f')
+      d = *s - 'a' + 10;
+    else
+      return -1;
+    m = m * base + d;
+  }
+  *mask = m;
+  return 0;
+}
+
+// parse a list of names like "read,write" into *mask.
+int
+parsenames(char *s, uint64 *mask)
+{
+  uint64 m = 0;
+  char *e;
+  int i, last;
+
+  do {
+    for(e = s; *e && *e != ','; e++)
+      ;
+    last = *e == 0;
+    *e = 0;
+    for(i = 1; i < NELEM(names); i++)
+      if(names[i] && strcmp(names[i], s) == 0)
+        break;
+    if(i == NELEM(names)){
+      fprintf(2, "trace: no system call %s\n", s);
+      return -1;
+    }
+    m |= 1L << i;
+    s = e + 1;
+  } while(!last);
+  *mask = m;
+  return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+  uint64 mask;
+
+  if(argc < 3){
+    fprintf(2, "usage: trace mask|name,... command [args...]\n");
+    exit(1);
+  }
+  if(argv[1][0] >= '0' && argv[1][0] <= '9'){
+    if(parsenum(argv[1], &mask) < 0){
+      fprintf(2, "trace: bad mask %s\n", argv[1]);
+      exit(1);
+    }
+  } else if(parsenames(argv[1], &mask) < 0)
+    exit(1);
+  if(trace(mask) < 0){
+    fprintf(2, "trace: trace failed\n");
+    exit(1);
+  }
+  exec(argv[2], argv + 2);
+  fprintf(2, "trace: exec %s failed\n", argv[2]);
+  exit(1);
+}
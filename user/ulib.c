@@ -1,6 +1,10 @@
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/riscv.h"
+#include "kernel/memlayout.h"
+#include "kernel/time.h"
 #include "user/user.h"
 
 char*
@@ -87,12 +91,15 @@ stat(const char *n, struct stat *st)
 int
 atoi(const char *s)
 {
-  int n;
+  int n, neg;
 
   n = 0;
+  neg = *s == '-';
+  if(neg)
+    s++;
   while('0' <= *s && *s <= '9')
     n = n*10 + *s++ - '0';
-  return n;
+  return neg ? -n : n;
 }
 
 void*
@@ -134,3 +141,39 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// getpid(), uptime() and clock_gettime() without a trap:
+// read the kernel's USYSCALL page and the time CSR.
+
+int
+ugetpid(void)
+{
+  uint64 tp = r_tp();
+
+  if(tp < USYSCALLPID(0) || tp >= USYSCALLPID(NTHREAD) ||
+     (tp - USYSCALLPID(0)) % sizeof(int) != 0)
+    return getpid();
+  return *(int *)tp;
+}
+
+// approximately uptime(); may run a tick ahead of it.
+int
+uuptime(void)
+{
+  struct usyscall *u = (struct usyscall *)USYSCALL;
+  return r_time() / u->tickcycles;
+}
+
+int
+uclock_gettime(int clk, struct timespec *ts)
+{
+  struct usyscall *u = (struct usyscall *)USYSCALL;
+  uint64 t;
+
+  if(clk != CLOCK_MONOTONIC)
+    return clock_gettime(clk, ts);
+  t = r_time();
+  ts->sec = t / u->clockfreq;
+  ts->nsec = (t % u->clockfreq) * (1000000000 / u->clockfreq);
+  return 0;
+}
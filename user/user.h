@@ -1,5 +1,16 @@
 struct stat;
 struct rtcdate;
+struct timespec;
+struct ring;
+struct ringcqe;
+struct lockstat;
+struct profsample;
+struct sysstat;
+struct ktevent;
+struct rusage;
+struct procinfo;
+struct cpuinfo;
+struct bcstat;
 
 // system calls
 int fork(void);
@@ -23,6 +34,24 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int clock_gettime(int, struct timespec*);
+struct ring* ringsetup(void);
+int ringenter(int);
+int clone(void(*)(void*), void*, void*);
+int futex(int*, int, int);
+int setpriority(int, int);
+int waitpid(int, int*);
+int lockstat(struct lockstat*, int);
+int prof(int, struct profsample*, int);
+int sysstat(struct sysstat*, int);
+int trace(uint64);
+int ktrace(int);
+int ktread(struct ktevent*, int);
+int getrusage(int, struct rusage*);
+int procinfo(struct procinfo*, int);
+int cpuinfo(struct cpuinfo*, int);
+int bcstat(struct bcstat*);
+int sync(void);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -40,3 +69,13 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+int ugetpid(void);
+int uuptime(void);
+int uclock_gettime(int, struct timespec*);
+
+// ring.c
+struct ring* ringinit(void);
+int ringsubmit(int, uint64, uint64, uint64, int, uint64);
+int ringflush(void);
+int ringreap(struct ringcqe*);
+int ringstat(const char*, struct stat*);
@@ -7,6 +7,15 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/time.h"
+#include "kernel/ring.h"
+#include "kernel/futex.h"
+#include "kernel/lockstat.h"
+#include "kernel/prof.h"
+#include "kernel/sysstat.h"
+#include "kernel/ktrace.h"
+#include "kernel/rusage.h"
+#include "kernel/bcstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -17,10 +26,13 @@
 // prints "OK".
 //
 
-#define BUFSZ  ((MAXOPBLOCKS+2)*BSIZE)
+#define BUFSZ  ((MAXOPBLOCKS+2)*MAXBSIZE)
 
 char buf[BUFSZ];
 
+// the file system's block size, BSIZE, from stat().
+uint fsbsize;
+
 // what if you pass ridiculous pointers to system calls
 // that read user memory with copyin?
 void
@@ -1865,50 +1877,62 @@ bigfile(char *s)
   unlink("bigfile.dat");
 }
 
+// a name longer than DIRSIZ is cut to DIRSIZ.
 void
-fourteen(char *s)
+dirsiz(char *s)
 {
-  int fd;
+  int fd, i;
+  char a[DIRSIZ+1], b[DIRSIZ+2], p[2*DIRSIZ+4];
 
-  // DIRSIZ is 14.
+  for(i = 0; i <= DIRSIZ; i++)
+    a[i] = b[i] = '0' + (i+1) % 10;
+  a[DIRSIZ] = 0;
+  b[DIRSIZ+1] = 0;
 
-  if(mkdir("12345678901234") != 0){
-    printf("%s: mkdir 12345678901234 failed\n", s);
-    exit(1);
-  }
-  if(mkdir("12345678901234/123456789012345") != 0){
-    printf("%s: mkdir 12345678901234/123456789012345 failed\n", s);
+  if(mkdir(a) != 0){
+    printf("%s: mkdir %s failed\n", s, a);
     exit(1);
   }
-  fd = open("123456789012345/123456789012345/123456789012345", O_CREATE);
+  strcpy(p, b);
+  strcpy(p + strlen(p), "/");
+  strcpy(p + strlen(p), b);
+  fd = open(p, O_CREATE);
   if(fd < 0){
-    printf("%s: create 123456789012345/123456789012345/123456789012345 failed\n", s);
+    printf("%s: create %s failed\n", s, p);
     exit(1);
   }
   close(fd);
-  fd = open("12345678901234/12345678901234/12345678901234", 0);
+  strcpy(p, a);
+  strcpy(p + strlen(p), "/");
+  strcpy(p + strlen(p), a);
+  fd = open(p, 0);
   if(fd < 0){
-    printf("%s: open 12345678901234/12345678901234/12345678901234 failed\n", s);
+    printf("%s: open %s failed\n", s, p);
     exit(1);
   }
   close(fd);
 
-  if(mkdir("12345678901234/12345678901234") == 0){
-    printf("%s: mkdir 12345678901234/12345678901234 succeeded!\n", s);
+  if(mkdir(p) == 0){
+    printf("%s: mkdir %s succeeded!\n", s, p);
     exit(1);
   }
-  if(mkdir("123456789012345/12345678901234") == 0){
-    printf("%s: mkdir 12345678901234/123456789012345 succeeded!\n", s);
+  strcpy(p, b);
+  strcpy(p + strlen(p), "/");
+  strcpy(p + strlen(p), a);
+  if(mkdir(p) == 0){
+    printf("%s: mkdir %s succeeded!\n", s, p);
     exit(1);
   }
 
   // clean up
-  unlink("123456789012345/12345678901234");
-  unlink("12345678901234/12345678901234");
-  unlink("12345678901234/12345678901234/12345678901234");
-  unlink("123456789012345/123456789012345/123456789012345");
-  unlink("12345678901234/123456789012345");
-  unlink("12345678901234");
+  if(unlink(a) == 0){
+    printf("%s: unlink of non-empty %s succeeded!\n", s, a);
+    exit(1);
+  }
+  if(unlink(p) != 0 || unlink(a) != 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
 }
 
 void
@@ -2041,12 +2065,12 @@ iref(char *s)
 }
 
 // test that fork fails gracefully
-// the forktest binary also does this, but it runs out of proc entries first.
-// inside the bigger usertests binary, we run out of memory first.
+// there is no fixed limit on procs, so fork() only
+// fails when the kernel runs out of memory.
 void
 forktest(char *s)
 {
-  enum{ N = 1000 };
+  enum{ N = 100000 };
   int n, pid;
 
   for(n=0; n<N; n++){
@@ -2063,7 +2087,7 @@ forktest(char *s)
   }
 
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work 100000 times!\n", s);
     exit(1);
   }
 
@@ -2706,113 +2730,1416 @@ execout(char *s)
   exit(0);
 }
 
-//
-// use sbrk() to count how many free physical memory pages there are.
-// touches the pages to force allocation.
-// because out of memory with lazy allocation results in the process
-// taking a fault and being killed, fork and report back.
-//
-int
-countfree()
+// clock_gettime() must be monotonic, keep nsec below one
+// second, and advance across a sleep.
+void
+clocktest(char *s)
 {
-  int fds[2];
+  struct timespec t0, t1;
+  uint64 ns0, ns1;
 
-  if(pipe(fds) < 0){
-    printf("pipe() failed in countfree()\n");
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) < 0){
+    printf("%s: clock_gettime failed\n", s);
     exit(1);
   }
-  
-  int pid = fork();
+  if(clock_gettime(-1, &t1) != -1){
+    printf("%s: clock_gettime accepted a bad clock\n", s);
+    exit(1);
+  }
+  sleep(2);
+  if(clock_gettime(CLOCK_MONOTONIC, &t1) < 0){
+    printf("%s: clock_gettime failed\n", s);
+    exit(1);
+  }
+  if(t0.nsec >= 1000000000 || t1.nsec >= 1000000000){
+    printf("%s: nsec out of range\n", s);
+    exit(1);
+  }
+  ns0 = t0.sec * 1000000000 + t0.nsec;
+  ns1 = t1.sec * 1000000000 + t1.nsec;
+  // a tick is about 1/10th of a second in qemu.
+  if(ns1 <= ns0 || ns1 - ns0 < 50000000){
+    printf("%s: clock did not advance across sleep\n", s);
+    exit(1);
+  }
+}
 
+// the USYSCALL page must agree with the real system calls,
+// in both parent and child, and must not be writable.
+void
+usyscalltest(char *s)
+{
+  struct timespec t0, t1, t2;
+  uint64 ns0, ns1, ns2;
+  int pid, xstatus, t, u;
+
+  if(ugetpid() != getpid()){
+    printf("%s: ugetpid %d != getpid %d\n", s, ugetpid(), getpid());
+    exit(1);
+  }
+  t = uptime();
+  u = uuptime();
+  if(u < t - 1 || u > t + 2){
+    printf("%s: uuptime %d far from uptime %d\n", s, u, t);
+    exit(1);
+  }
+  uclock_gettime(CLOCK_MONOTONIC, &t0);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  uclock_gettime(CLOCK_MONOTONIC, &t2);
+  ns0 = t0.sec * 1000000000 + t0.nsec;
+  ns1 = t1.sec * 1000000000 + t1.nsec;
+  ns2 = t2.sec * 1000000000 + t2.nsec;
+  if(ns1 < ns0 || ns2 < ns1){
+    printf("%s: uclock_gettime out of order with clock_gettime\n", s);
+    exit(1);
+  }
+
+  pid = fork();
   if(pid < 0){
-    printf("fork failed in countfree()\n");
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    exit(ugetpid() == getpid() ? 0 : 1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: ugetpid wrong in child\n", s);
     exit(1);
   }
 
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
   if(pid == 0){
-    close(fds[0]);
-    
-    while(1){
-      uint64 a = (uint64) sbrk(4096);
-      if(a == 0xffffffffffffffff){
-        break;
-      }
+    *(volatile int *)USYSCALL = 0;
+    printf("%s: wrote the USYSCALL page\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != -1)  // did kernel kill child?
+    exit(1);
+}
 
-      // modify the memory to make sure it's really allocated.
-      *(char *)(a + 4096 - 1) = 1;
+// batch system calls through the submission ring, including
+// the fd-passing flag, a refused call, and a forked child.
+void
+ringtest(char *s)
+{
+  struct ringcqe c;
+  long res[5];
+  char rbuf[8];
+  int i, pid, xstatus;
 
-      // report back one more page.
-      if(write(fds[1], "x", 1) != 1){
-        printf("write() failed in countfree()\n");
-        exit(1);
-      }
+  if(ringinit() == 0){
+    printf("%s: ringsetup failed\n", s);
+    exit(1);
+  }
+  unlink("ringfile");
+  ringsubmit(SYS_open, (uint64)"ringfile", O_CREATE|O_RDWR, 0, 0, 0);
+  ringsubmit(SYS_write, 0, (uint64)"abcdefg", 7, RING_LASTFD, 1);
+  ringsubmit(SYS_close, 0, 0, 0, RING_LASTFD, 2);
+  ringsubmit(SYS_fork, 0, 0, 0, 0, 3);
+  ringsubmit(SYS_getpid, 0, 0, 0, 0, 4);
+  if(ringflush() != 5){
+    printf("%s: ringenter did not run the batch\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 5; i++){
+    if(ringreap(&c) == 0 || c.udata != i){
+      printf("%s: missing completion %d\n", s, i);
+      exit(1);
     }
+    res[i] = c.res;
+  }
+  if(ringreap(&c) != 0){
+    printf("%s: extra completion\n", s);
+    exit(1);
+  }
+  if(res[0] < 0 || res[1] != 7 || res[2] != 0 || res[3] != -1 || res[4] != -1){
+    printf("%s: wrong batch results\n", s);
+    exit(1);
+  }
 
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    ringsubmit(SYS_open, (uint64)"ringfile", O_RDONLY, 0, 0, 0);
+    ringsubmit(SYS_read, 0, (uint64)rbuf, sizeof(rbuf), RING_LASTFD, 1);
+    ringsubmit(SYS_close, 0, 0, 0, RING_LASTFD, 2);
+    ringflush();
+    ringreap(&c);
+    ringreap(&c);
+    if(c.res != 7 || memcmp(rbuf, "abcdefg", 7) != 0)
+      exit(1);
     exit(0);
   }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: ring broken in child\n", s);
+    exit(1);
+  }
+  unlink("ringfile");
+}
 
-  close(fds[1]);
+// clone() threads share memory and sleep on it with futex().
+// shrinking the heap while they run takes the TLB shootdown path.
+#define NTHR 4
+int threadgo, threadsum, threaddone;
 
-  int n = 0;
-  while(1){
-    char c;
-    int cc = read(fds[0], &c, 1);
-    if(cc < 0){
-      printf("read() failed in countfree()\n");
+void
+threadfn(void *arg)
+{
+  int i;
+
+  while(__atomic_load_n(&threadgo, __ATOMIC_ACQUIRE) == 0)
+    futex(&threadgo, FUTEX_WAIT, 0);
+  for(i = 0; i < 1000; i++)
+    __atomic_fetch_add(&threadsum, (int)(uint64)arg, __ATOMIC_RELAXED);
+  while(__atomic_load_n(&threaddone, __ATOMIC_ACQUIRE) == 0)
+    ;
+  exit(0);
+}
+
+void
+threadtest(char *s)
+{
+  char *stacks[NTHR], *a;
+  int i, xstatus;
+
+  threadgo = threadsum = threaddone = 0;
+  for(i = 0; i < NTHR; i++){
+    stacks[i] = malloc(4096);
+    if(clone(threadfn, (void*)(uint64)(i+1), stacks[i] + 4096) < 0){
+      printf("%s: clone failed\n", s);
       exit(1);
     }
-    if(cc == 0)
-      break;
-    n += 1;
+  }
+  sleep(1);
+  __atomic_store_n(&threadgo, 1, __ATOMIC_RELEASE);
+  if(futex(&threadgo, FUTEX_WAKE, NTHR) < 0){
+    printf("%s: futex wake failed\n", s);
+    exit(1);
+  }
+  // the value is no longer 0, so this must not sleep.
+  if(futex(&threadgo, FUTEX_WAIT, 0) != -1){
+    printf("%s: futex wait slept on a stale value\n", s);
+    exit(1);
   }
 
-  close(fds[0]);
-  wait((int*)0);
-  
-  return n;
+  for(i = 0; i < 10; i++){
+    a = sbrk(10*4096);
+    if(a == (char*)0xffffffffffffffffL){
+      printf("%s: sbrk failed\n", s);
+      exit(1);
+    }
+    a[0] = a[10*4096-1] = 1;
+    sbrk(-10*4096);
+  }
+
+  __atomic_store_n(&threaddone, 1, __ATOMIC_RELEASE);
+  for(i = 0; i < NTHR; i++){
+    if(wait(&xstatus) < 0 || xstatus != 0){
+      printf("%s: thread failed\n", s);
+      exit(1);
+    }
+  }
+  if(threadsum != 1000*NTHR*(NTHR+1)/2){
+    printf("%s: threads lost updates, sum %d\n", s, threadsum);
+    exit(1);
+  }
+  for(i = 0; i < NTHR; i++)
+    free(stacks[i]);
 }
 
-// run each test in its own process. run returns 1 if child's exit()
-// indicates success.
+// spin until killed; for nicetest.
 int
-run(void f(char *), char *s) {
+nicespin(int nice)
+{
   int pid;
-  int xstatus;
 
-  printf("test %s: ", s);
-  if((pid = fork()) < 0) {
-    printf("runtest: fork error\n");
+  pid = fork();
+  if(pid < 0){
+    printf("nicetest: fork failed\n");
     exit(1);
   }
-  if(pid == 0) {
-    f(s);
+  if(pid == 0){
+    setpriority(getpid(), nice);
+    for(;;)
+      ;
+  }
+  return pid;
+}
+
+// CPU time of child pid, which is killed and waited for.
+uint64
+nicetime(int pid)
+{
+  struct rusage r0, r1;
+
+  getrusage(RUSAGE_CHILDREN, &r0);
+  kill(pid);
+  waitpid(pid, 0);
+  getrusage(RUSAGE_CHILDREN, &r1);
+  return (r1.utime + r1.stime) - (r0.utime + r0.stime);
+}
+
+// spinners at nice 0 and nice 10 on one CPU share it about
+// 9 to 1, by the weights in sched.c.
+void
+nicetest(char *s)
+{
+  enum { NFILL = 8 };
+  int i, pid0, pid10;
+  int fill[NFILL];
+  uint64 t0, t10;
+
+  if(setpriority(getpid(), 0) != 0 || setpriority(1000000, 0) != -1){
+    printf("%s: setpriority wrong result\n", s);
+    exit(1);
+  }
+  // keep every CPU busy, so that none goes idle and takes
+  // one of the two below from the queue they are forked on.
+  // at nice 19 the fillers take little of that CPU.
+  for(i = 0; i < NFILL; i++)
+    fill[i] = nicespin(19);
+  sleep(2);
+  pid0 = nicespin(0);
+  pid10 = nicespin(10);
+  sleep(40);
+  t10 = nicetime(pid10);
+  t0 = nicetime(pid0);
+  for(i = 0; i < NFILL; i++){
+    kill(fill[i]);
+    wait(0);
+  }
+  if(t10 == 0 || t0 < 4 * t10 || t0 > 20 * t10){
+    printf("%s: nice 0 ran %d ms, nice 10 ran %d ms\n", s,
+           (int)(t0 / 1000), (int)(t10 / 1000));
+    exit(1);
+  }
+}
+
+// waitpid() reaps the child it is asked for, whatever
+// order the children exit in.
+void
+waitpidtest(char *s)
+{
+  int i, pid, xstatus;
+  int pids[3];
+
+  for(i = 0; i < 3; i++){
+    pids[i] = fork();
+    if(pids[i] < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pids[i] == 0){
+      sleep(3 - i);
+      exit(10 + i);
+    }
+  }
+  if(waitpid(getpid(), 0) != -1){
+    printf("%s: waitpid of a non-child succeeded\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 3; i++){
+    pid = waitpid(pids[i], &xstatus);
+    if(pid != pids[i] || xstatus != 10 + i){
+      printf("%s: waitpid(%d) returned %d, status %d\n", s, pids[i], pid, xstatus);
+      exit(1);
+    }
+  }
+  if(wait(0) != -1){
+    printf("%s: children left over\n", s);
+    exit(1);
+  }
+}
+
+// lockstat() counts acquires of the proc locks, which
+// fork() and wait() take.
+void
+lockstattest(char *s)
+{
+  static struct lockstat ls[64];
+  uint64 n0;
+  int i, n, pid;
+
+  n0 = 0;
+  n = lockstat(ls, 64);
+  for(i = 0; i < n; i++)
+    if(strcmp(ls[i].name, "proc") == 0)
+      n0 = ls[i].nacquire;
+  if(n0 == 0){
+    printf("%s: no proc lock acquires\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0)
     exit(0);
-  } else {
-    wait(&xstatus);
-    if(xstatus != 0) 
-      printf("FAILED\n");
-    else
-      printf("OK\n");
-    return xstatus == 0;
+  wait(0);
+  if(lockstat(ls, 1) != 1 || lockstat(ls, 64) < n){
+    printf("%s: lockstat returned wrong count\n", s);
+    exit(1);
   }
+  for(i = 0; i < n; i++)
+    if(strcmp(ls[i].name, "proc") == 0 && ls[i].nacquire > n0)
+      return;
+  printf("%s: fork did not count proc lock acquires\n", s);
+  exit(1);
 }
 
-int
-main(int argc, char *argv[])
+// the profiler catches this process spinning in user space.
+void
+proftest(char *s)
 {
-  int continuous = 0;
-  char *justone = 0;
+  static struct profsample ps[64];
+  int i, n, t0, found;
+  volatile int x = 0;
 
-  if(argc == 2 && strcmp(argv[1], "-c") == 0){
-    continuous = 1;
-  } else if(argc == 2 && strcmp(argv[1], "-C") == 0){
-    continuous = 2;
-  } else if(argc == 2 && argv[1][0] != '-'){
-    justone = argv[1];
-  } else if(argc > 1){
-    printf("Usage: usertests [-c] [testname]\n");
+  if(prof(PROF_START, 0, 0) < 0){
+    printf("%s: prof start failed\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  while(uptime() < t0 + 3)
+    x++;
+  prof(PROF_STOP, 0, 0);
+
+  found = 0;
+  while((n = prof(PROF_READ, ps, 64)) > 0){
+    for(i = 0; i < n; i++)
+      if(ps[i].pid == getpid() && ps[i].user && ps[i].pc < 0x100000)
+        found = 1;
+  }
+  if(n < 0){
+    printf("%s: prof read failed\n", s);
+    exit(1);
+  }
+  if(!found){
+    printf("%s: no user samples of this process\n", s);
+    exit(1);
+  }
+}
+
+// sysstat() counts calls and failed calls.
+void
+sysstattest(char *s)
+{
+  static struct sysstat st0[SYS_close+1], st1[SYS_close+1];
+  uint64 h;
+  int i;
+
+  if(sysstat(st0, SYS_close+1) <= SYS_close){
+    printf("%s: sysstat failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 10; i++)
+    getpid();
+  close(-1);
+  sysstat(st1, SYS_close+1);
+  if(st1[SYS_getpid].count - st0[SYS_getpid].count < 10){
+    printf("%s: getpid calls not counted\n", s);
+    exit(1);
+  }
+  if(st1[SYS_close].errors == st0[SYS_close].errors){
+    printf("%s: failed close not counted\n", s);
+    exit(1);
+  }
+  h = 0;
+  for(i = 0; i < NSYSHIST; i++)
+    h += st1[SYS_getpid].hist[i];
+  if(h != st1[SYS_getpid].count){
+    printf("%s: histogram does not add up\n", s);
+    exit(1);
+  }
+}
+
+// ktrace() records this process sleeping and being
+// switched back in.
+void
+ktracetest(char *s)
+{
+  static struct ktevent ev[64];
+  uint64 slept, ran;
+  int i, n;
+
+  if(ktrace(KT_SCHED|KT_SLEEP) < 0){
+    printf("%s: ktrace failed\n", s);
+    exit(1);
+  }
+  sleep(2);
+  ktrace(0);
+
+  slept = ran = 0;
+  while((n = ktread(ev, 64)) > 0){
+    for(i = 0; i < n; i++){
+      if(ev[i].pid != getpid())
+        continue;
+      // events come a CPU at a time, so go by the times.
+      if(ev[i].type == KE_SLEEP && slept == 0)
+        slept = ev[i].time;
+      if(ev[i].type == KE_SWITCHIN && ev[i].time > ran)
+        ran = ev[i].time;
+    }
+  }
+  if(n < 0 || slept == 0 || ran < slept){
+    printf("%s: events missing\n", s);
+    exit(1);
+  }
+}
+
+// getrusage() and procinfo() see user time, sleeps and
+// bytes written, and a waited-for child's user time.
+void
+rusagetest(char *s)
+{
+  static struct procinfo pi[64];
+  struct rusage ru;
+  int i, n, pid, t0, fds[2];
+  volatile int x = 0;
+
+  t0 = uptime();
+  while(uptime() < t0 + 3)
+    x++;
+  sleep(1);
+  if(pipe(fds) < 0 || write(fds[1], "hello", 5) != 5){
+    printf("%s: pipe write failed\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  if(getrusage(RUSAGE_SELF, &ru) < 0){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  if(ru.utime == 0 || ru.nvcsw == 0 || ru.wbytes < 5){
+    printf("%s: usage not counted\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    t0 = uptime();
+    while(uptime() < t0 + 3)
+      x++;
+    exit(0);
+  }
+  n = procinfo(pi, 64);
+  for(i = 0; i < n; i++)
+    if(pi[i].pid == pid && pi[i].ppid == getpid())
+      break;
+  if(i == n){
+    printf("%s: procinfo missed child\n", s);
+    exit(1);
+  }
+  wait(0);
+  if(getrusage(RUSAGE_CHILDREN, &ru) < 0 || ru.utime == 0){
+    printf("%s: child usage not counted\n", s);
+    exit(1);
+  }
+}
+
+// the cycle and instret counts getrusage() reports
+// keep up with a loop of known length.
+void
+perfcounttest(char *s)
+{
+  struct rusage r0, r1;
+  volatile int x = 0;
+  int i;
+
+  if(getrusage(RUSAGE_SELF, &r0) < 0){
+    printf("%s: getrusage failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 1000000; i++)
+    x++;
+  getrusage(RUSAGE_SELF, &r1);
+  if(r1.instret - r0.instret < 1000000 || r1.cycles == r0.cycles){
+    printf("%s: counters not charged\n", s);
+    exit(1);
+  }
+}
+
+// names that come and go, and change from file to
+// directory, must not be found stale in the dentry cache.
+void
+dcachetest(char *s)
+{
+  int fd;
+
+  if(mkdir("dcd") < 0){
+    printf("%s: mkdir dcd failed\n", s);
+    exit(1);
+  }
+  if(open("dcd/f", O_RDONLY) >= 0 || open("dcd/f", O_RDONLY) >= 0){
+    printf("%s: opened missing dcd/f\n", s);
+    exit(1);
+  }
+  if((fd = open("dcd/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create dcd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(link("dcd/f", "dcd/g") < 0 || (fd = open("dcd/g", O_RDONLY)) < 0){
+    printf("%s: link dcd/g failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(unlink("dcd/f") < 0 || open("dcd/f", O_RDONLY) >= 0){
+    printf("%s: dcd/f still there\n", s);
+    exit(1);
+  }
+  if((fd = open("dcd/g", O_RDONLY)) < 0){
+    printf("%s: dcd/g gone\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // a directory in place of the file, then a file again.
+  if(mkdir("dcd/f") < 0 || (fd = open("dcd/f/x", O_CREATE|O_RDWR)) < 0){
+    printf("%s: dcd/f/x failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(unlink("dcd/f/x") < 0 || unlink("dcd/f") < 0){
+    printf("%s: unlink dcd/f failed\n", s);
+    exit(1);
+  }
+  if((fd = open("dcd/f", O_CREATE|O_RDWR)) < 0){
+    printf("%s: recreate dcd/f failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(open("dcd/f/x", O_RDONLY) >= 0){
+    printf("%s: opened dcd/f/x in a file\n", s);
+    exit(1);
+  }
+  if(unlink("dcd/f") < 0 || unlink("dcd/g") < 0 || unlink("dcd") < 0){
+    printf("%s: cleanup failed\n", s);
+    exit(1);
+  }
+}
+
+// a file larger than the old block map allowed,
+// written in pieces that don't line up with blocks.
+void
+extentfile(char *s)
+{
+  enum { SZ = 3000 };
+  int N = MAXFILE + 200;
+  int fd, i, j, n;
+  uint off;
+
+  unlink("xbig");
+  fd = open("xbig", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create xbig failed\n", s);
+    exit(1);
+  }
+  for(off = 0; off < N*BSIZE; off += n){
+    n = N*BSIZE - off < SZ ? N*BSIZE - off : SZ;
+    for(j = 0; j < n; j++)
+      buf[j] = (off + j) / BSIZE;
+    if(write(fd, buf, n) != n){
+      printf("%s: write xbig at %d failed\n", s, off);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  fd = open("xbig", O_RDONLY);
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, BSIZE) != BSIZE){
+      printf("%s: read xbig block %d failed\n", s, i);
+      exit(1);
+    }
+    for(j = 0; j < BSIZE; j++){
+      if(buf[j] != (char)i){
+        printf("%s: xbig block %d has %d\n", s, i, buf[j]);
+        exit(1);
+      }
+    }
+  }
+  if(read(fd, buf, 1) != 0){
+    printf("%s: xbig too long\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(unlink("xbig") < 0){
+    printf("%s: unlink xbig failed\n", s);
+    exit(1);
+  }
+}
+
+// make files zz.. until open() fails or there are nzz;
+// returns how many it made.
+int
+oifill(int nzz)
+{
+  char name[8];
+  int i, fd;
+
+  for(i = 0; i < nzz; i++){
+    name[0] = 'z';
+    name[1] = 'z';
+    name[2] = '0' + (i / 32);
+    name[3] = '0' + (i % 32);
+    name[4] = '\0';
+    unlink(name);
+    fd = open(name, O_CREATE|O_RDWR|O_TRUNC);
+    if(fd < 0){
+      // failure is eventually expected.
+      break;
+    }
+    close(fd);
+  }
+  return i;
+}
+
+void
+oiclean(int nzz)
+{
+  char name[8];
+  int i;
+
+  for(i = 0; i < nzz; i++){
+    name[0] = 'z';
+    name[1] = 'z';
+    name[2] = '0' + (i / 32);
+    name[3] = '0' + (i % 32);
+    name[4] = '\0';
+    unlink(name);
+  }
+}
+
+// a new file's inode goes just after its directory's; and
+// running out of inodes makes open() fail, rather than the
+// kernel panic, and once they are freed as many can be made
+// again.
+void
+outofinodes(char *s)
+{
+  int nzz = 32*32;
+  int i, fd, n1, n2;
+  struct stat dst, fst;
+
+  // a directory in the last inode block sends its files
+  // around to the start, so a second one is in range.
+  for(i = 0; i < 2; i++){
+    if(mkdir("oidir") < 0 || (fd = open("oidir/f", O_CREATE|O_RDWR)) < 0){
+      printf("%s: create oidir/f failed\n", s);
+      exit(1);
+    }
+    fstat(fd, &fst);
+    close(fd);
+    stat("oidir", &dst);
+    unlink("oidir/f");
+    unlink("oidir");
+    if(fst.ino > dst.ino && fst.ino < dst.ino + IPB)
+      break;
+  }
+  if(i == 2){
+    printf("%s: inode %d for a file in directory %d\n", s, fst.ino, dst.ino);
+    exit(1);
+  }
+
+  n1 = oifill(nzz);
+  oiclean(nzz);
+  n2 = oifill(nzz);
+  oiclean(nzz);
+  if(n1 == 0 || n2 != n1){
+    printf("%s: made %d files, then %d after unlinking them\n", s, n1, n2);
+    exit(1);
+  }
+}
+
+// many long names in one directory: each can be found,
+// and reading the directory returns each once, whole.
+void
+hashdir(char *s)
+{
+  enum { N = 600 };
+  int fd, i, n;
+  char name[48];
+  struct dirent de;
+  static char seen[N];
+
+  if(mkdir("hd") != 0){
+    printf("%s: mkdir hd failed\n", s);
+    exit(1);
+  }
+  fd = open("hd/target", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create hd/target failed\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  strcpy(name, "hd/a-name-rather-longer-than-fourteen-");
+  n = strlen(name);
+  for(i = 0; i < N; i++){
+    name[n] = '0' + i / 100;
+    name[n+1] = '0' + (i / 10) % 10;
+    name[n+2] = '0' + i % 10;
+    name[n+3] = 0;
+    if(link("hd/target", name) != 0){
+      printf("%s: link %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  for(i = N-1; i >= 0; i -= 7){
+    name[n] = '0' + i / 100;
+    name[n+1] = '0' + (i / 10) % 10;
+    name[n+2] = '0' + i % 10;
+    if((fd = open(name, 0)) < 0){
+      printf("%s: open %s failed\n", s, name);
+      exit(1);
+    }
+    close(fd);
+  }
+
+  if((fd = open("hd", 0)) < 0){
+    printf("%s: open hd failed\n", s);
+    exit(1);
+  }
+  memset(seen, 0, sizeof(seen));
+  n -= 3;  // without "hd/"
+  while(read(fd, &de, sizeof(de)) == sizeof(de)){
+    if(de.inum == 0)
+      continue;
+    if(strcmp(de.name, ".") == 0 || strcmp(de.name, "..") == 0 ||
+       strcmp(de.name, "target") == 0)
+      continue;
+    if(strlen(de.name) != n + 3 || memcmp(de.name, name + 3, n) != 0){
+      printf("%s: bad name %s in hd\n", s, de.name);
+      exit(1);
+    }
+    i = atoi(de.name + n);
+    if(i < 0 || i >= N || seen[i]++){
+      printf("%s: %s twice in hd\n", s, de.name);
+      exit(1);
+    }
+  }
+  close(fd);
+  n += 3;
+
+  for(i = 0; i < N; i++){
+    if(!seen[i]){
+      printf("%s: name %d missing from hd\n", s, i);
+      exit(1);
+    }
+    name[n] = '0' + i / 100;
+    name[n+1] = '0' + (i / 10) % 10;
+    name[n+2] = '0' + i % 10;
+    if(unlink(name) != 0){
+      printf("%s: unlink %s failed\n", s, name);
+      exit(1);
+    }
+  }
+  if(unlink("hd/target") != 0 || unlink("hd") != 0){
+    printf("%s: unlink hd failed\n", s);
+    exit(1);
+  }
+}
+
+// more files open at once than the old fixed inode table held.
+void
+manyinodes(char *s)
+{
+  enum { NCHILD = 8, PER = 11 };
+  int i, j, pid, fd, ready[2], done[2], xstatus;
+  char name[8], c;
+
+  if(pipe(ready) != 0 || pipe(done) != 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", s);
+      exit(1);
+    }
+    if(pid == 0){
+      close(ready[0]);
+      close(done[1]);
+      name[0] = 'm';
+      name[1] = 'i';
+      name[2] = '0' + i;
+      name[4] = 0;
+      for(j = 0; j < PER; j++){
+        name[3] = 'a' + j;
+        if((fd = open(name, O_CREATE|O_RDWR)) < 0){
+          printf("%s: create %s failed\n", s, name);
+          exit(1);
+        }
+      }
+      // hold them open until every child has its files.
+      write(ready[1], "x", 1);
+      read(done[0], &c, 1);
+      for(j = 0; j < PER; j++){
+        name[3] = 'a' + j;
+        unlink(name);
+      }
+      exit(0);
+    }
+  }
+  close(ready[1]);
+  close(done[0]);
+  for(i = 0; i < NCHILD; i++)
+    if(read(ready[0], &c, 1) != 1)
+      break;
+  close(ready[0]);
+  close(done[1]);
+  for(i = 0; i < NCHILD; i++){
+    wait(&xstatus);
+    if(xstatus != 0)
+      exit(1);
+  }
+}
+
+// file data lives in the page cache, but directories go through
+// the buffer cache: more directory blocks than the old fixed cache
+// held should stay cached, so reading them again hardly touches
+// the disk.
+void
+bcachegrow(char *s)
+{
+  enum { NDIR = 100 };
+  struct bcstat st0, st1;
+  char name[16];
+  int fd, i, pass;
+
+  if(mkdir("bcgrow") < 0){
+    printf("%s: mkdir bcgrow failed\n", s);
+    exit(1);
+  }
+  strcpy(name, "bcgrow/d000");
+  for(i = 0; i < NDIR; i++){
+    name[8] = '0' + i / 100;
+    name[9] = '0' + (i / 10) % 10;
+    name[10] = '0' + i % 10;
+    if(mkdir(name) < 0){
+      printf("%s: mkdir %s failed\n", s, name);
+      exit(1);
+    }
+  }
+
+  for(pass = 0; pass < 2; pass++){
+    if(bcstat(&st0) < 0){
+      printf("%s: bcstat failed\n", s);
+      exit(1);
+    }
+    for(i = 0; i < NDIR; i++){
+      name[8] = '0' + i / 100;
+      name[9] = '0' + (i / 10) % 10;
+      name[10] = '0' + i % 10;
+      if((fd = open(name, O_RDONLY)) < 0 || read(fd, buf, BSIZE) <= 0){
+        printf("%s: read %s failed\n", s, name);
+        exit(1);
+      }
+      close(fd);
+    }
+    bcstat(&st1);
+  }
+  for(i = 0; i < NDIR; i++){
+    name[8] = '0' + i / 100;
+    name[9] = '0' + (i / 10) % 10;
+    name[10] = '0' + i % 10;
+    unlink(name);
+  }
+  unlink("bcgrow");
+  if(st1.nbuf < NDIR){
+    printf("%s: only %d buffers\n", s, (int)st1.nbuf);
+    exit(1);
+  }
+  if(st1.misses - st0.misses > NDIR / 10){
+    printf("%s: %d misses reading bcgrow again\n", s, (int)(st1.misses - st0.misses));
+    exit(1);
+  }
+}
+
+// reads of a file come from the page cache, which must
+// see every write, and forget the data when it's truncated.
+void
+pagecache(char *s)
+{
+  enum { SZ = 5*4096 + 100 };
+  struct bcstat st0, st1;
+  int fd, i, pass;
+
+  fd = open("pcache", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create pcache failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < BSIZE; i++)
+    buf[i] = i % 251;
+  for(i = 0; i < SZ; i += BSIZE){
+    if(write(fd, buf, i + BSIZE > SZ ? SZ - i : BSIZE) < 0){
+      printf("%s: write pcache failed\n", s);
+      exit(1);
+    }
+  }
+  close(fd);
+
+  // read it twice; the second time should find every page.
+  for(pass = 0; pass < 2; pass++){
+    bcstat(&st0);
+    fd = open("pcache", O_RDONLY);
+    for(i = 0; i < SZ; i += 1000){
+      if(read(fd, buf, 1000) != (i + 1000 > SZ ? SZ - i : 1000) ||
+         (uchar)buf[0] != i % BSIZE % 251){
+        printf("%s: read pcache at %d failed\n", s, i);
+        exit(1);
+      }
+    }
+    close(fd);
+    bcstat(&st1);
+  }
+  if(st1.pmisses != st0.pmisses || st1.phits - st0.phits < SZ / 4096){
+    printf("%s: %d page misses reading pcache again\n", s,
+           (int)(st1.pmisses - st0.pmisses));
+    exit(1);
+  }
+
+  // overwrite the middle of a cached page.
+  fd = open("pcache", O_RDWR);
+  memset(buf, 'w', 3000);
+  if(read(fd, buf + 3000, 5000) != 5000 ||
+     write(fd, buf, 3000) != 3000){
+    printf("%s: rewrite pcache failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcache", O_RDWR);
+  if(read(fd, buf, 8100) != 8100 || buf[4999] == 'w' ||
+     buf[5000] != 'w' || buf[7999] != 'w' || buf[8000] == 'w'){
+    printf("%s: pcache doesn't see write\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // grow the file into the rest of its cached last page.
+  fd = open("pcache", O_RDWR);
+  while((i = read(fd, buf, BSIZE)) > 0)
+    ;
+  memset(buf, 'g', 2000);
+  if(i < 0 || write(fd, buf, 2000) != 2000){
+    printf("%s: append to pcache failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcache", O_RDONLY);
+  for(i = 0; i < SZ; i += BSIZE)
+    read(fd, buf, i + BSIZE > SZ ? SZ - i : BSIZE);
+  memset(buf, 0, 2000);
+  if(read(fd, buf, 2001) != 2000 || buf[0] != 'g' || buf[1999] != 'g'){
+    printf("%s: pcache doesn't see append\n", s);
+    exit(1);
+  }
+  close(fd);
+
+  // truncate, and write less.
+  fd = open("pcache", O_RDWR|O_TRUNC);
+  if(write(fd, "short", 5) != 5){
+    printf("%s: write after truncate failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  fd = open("pcache", O_RDONLY);
+  if(read(fd, buf, 4096) != 5 || memcmp(buf, "short", 5) != 0){
+    printf("%s: pcache has data from before truncate\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("pcache");
+}
+
+// file writes go to the page cache, and reach the
+// disk when the flush thread or sync() writes them back.
+void
+writeback(char *s)
+{
+  enum { N = 40 };
+  struct bcstat st0, st1;
+  struct stat st;
+  int fd, i;
+
+  sync();
+  bcstat(&st0);
+  fd = open("wback", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf("%s: create wback failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < N; i++){
+    memset(buf, 'a' + i % 26, BSIZE);
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write wback failed\n", s);
+      exit(1);
+    }
+  }
+  if(fstat(fd, &st) < 0 || st.size != N*BSIZE){
+    printf("%s: wback has the wrong size\n", s);
+    exit(1);
+  }
+  close(fd);
+  sync();
+  bcstat(&st1);
+  if(st1.ndirty != 0 || st1.pwrites - st0.pwrites < N){
+    printf("%s: sync left %d dirty pages, wrote %d blocks\n", s,
+           (int)st1.ndirty, (int)(st1.pwrites - st0.pwrites));
+    exit(1);
+  }
+
+  fd = open("wback", O_RDONLY);
+  for(i = 0; i < N; i++){
+    if(read(fd, buf, BSIZE) != BSIZE || buf[0] != 'a' + i % 26 ||
+       buf[BSIZE-1] != 'a' + i % 26){
+      printf("%s: wback block %d is wrong\n", s, i);
+      exit(1);
+    }
+  }
+  close(fd);
+  unlink("wback");
+}
+
+// pids that no process can have.
+void
+badpid(char *s)
+{
+  int pids[] = { 0, -1, -5, -61, -2147483647 };
+  int i;
+
+  for(i = 0; i < sizeof(pids)/sizeof(pids[0]); i++){
+    if(kill(pids[i]) != -1 || setpriority(pids[i], 0) != -1){
+      printf("%s: pid %d accepted\n", s, pids[i]);
+      exit(1);
+    }
+  }
+}
+
+// a clone()d thread's ugetpid() is its own pid, and a chdir()
+// by one thread moves the others too.
+int selfpid;
+
+void
+threadselffn(void *arg)
+{
+  uint64 tp;
+
+  selfpid = ugetpid() == getpid() ? ugetpid() : -1;
+  // a program that reuses tp gets getpid()'s answer.
+  tp = r_tp();
+  w_tp(USYSCALL + 1);
+  if(ugetpid() != getpid())
+    selfpid = -1;
+  w_tp(tp);
+  if(chdir("selfdir") < 0)
+    exit(1);
+  exit(0);
+}
+
+void
+threadself(char *s)
+{
+  char *stack;
+  int pid, fd, xstatus;
+
+  if(mkdir("selfdir") < 0){
+    printf("%s: mkdir failed\n", s);
+    exit(1);
+  }
+  selfpid = 0;
+  stack = malloc(4096);
+  if((pid = clone(threadselffn, 0, stack + 4096)) < 0){
+    printf("%s: clone failed\n", s);
+    exit(1);
+  }
+  if(wait(&xstatus) != pid || xstatus != 0){
+    printf("%s: thread failed\n", s);
+    exit(1);
+  }
+  if(selfpid != pid){
+    printf("%s: ugetpid %d in thread %d\n", s, selfpid, pid);
+    exit(1);
+  }
+  if(ugetpid() != getpid()){
+    printf("%s: ugetpid wrong after thread\n", s);
+    exit(1);
+  }
+
+  // the thread's chdir() moved us into selfdir.
+  if((fd = open("selffile", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create failed\n", s);
+    exit(1);
+  }
+  close(fd);
+  if(chdir("..") < 0 || (fd = open("selfdir/selffile", 0)) < 0){
+    printf("%s: thread's chdir not shared\n", s);
+    exit(1);
+  }
+  close(fd);
+  unlink("selfdir/selffile");
+  unlink("selfdir");
+  free(stack);
+}
+
+void
+threadexecfn(void *arg)
+{
+  int fd = (int)(uint64)arg;
+
+  for(;;){
+    write(fd, "x", 1);
+    sleep(1);
+  }
+}
+
+// exec() in a process with threads kills the others first:
+// the pipe sees EOF once the thread holding it is gone.
+void
+threadexec(char *s)
+{
+  char *echoargv[] = { "echo", "OK", 0 };
+  char *stack, buf[16];
+  int fds[2], pid, xstatus;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    stack = malloc(4096);
+    if(clone(threadexecfn, (void*)(uint64)fds[1], stack + 4096) < 0){
+      printf("%s: clone failed\n", s);
+      exit(1);
+    }
+    close(fds[1]);
+    sleep(2);
+    exec("echo", echoargv);
+    printf("%s: exec failed\n", s);
+    exit(1);
+  }
+  close(fds[1]);
+  while(read(fds[0], buf, sizeof(buf)) > 0)
+    ;
+  close(fds[0]);
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: exec with a thread failed\n", s);
+    exit(1);
+  }
+}
+
+// a new file's first block goes at or after the allocator's
+// goal for it, the groups' free counts drop by the blocks the
+// file takes, starting in the first block's group, and they
+// recover when it is unlinked.
+void
+bgroups(char *s)
+{
+  enum { N = 40 };
+  static struct bcstat st0, st1, st2;
+  struct stat st;
+  int fd, i, g, goal;
+  uint drop;
+
+  unlink("bgfile");
+  if((fd = open("bgfile", O_CREATE|O_RDWR)) < 0){
+    printf("%s: create bgfile failed\n", s);
+    exit(1);
+  }
+  sync();
+  // the file has no blocks yet, only a goal for the first.
+  if(fstat(fd, &st) < 0 || st.addr0 != 0 || st.goal == 0){
+    printf("%s: fstat of an empty file\n", s);
+    exit(1);
+  }
+  goal = st.goal;
+  if(bcstat(&st0) < 0){
+    printf("%s: bcstat failed\n", s);
+    exit(1);
+  }
+
+  memset(buf, 'b', BSIZE);
+  for(i = 0; i < N; i++){
+    if(write(fd, buf, BSIZE) != BSIZE){
+      printf("%s: write failed\n", s);
+      exit(1);
+    }
+  }
+  // writing the data back gives it disk blocks.
+  sync();
+  bcstat(&st1);
+  fstat(fd, &st);
+  if(st.addr0 < goal || st.goal <= st.addr0){
+    printf("%s: first block at %d, goal %d\n", s, st.addr0, goal);
+    exit(1);
+  }
+  drop = 0;
+  for(g = 0; g < st0.ngroup && g < NBCGROUP; g++)
+    drop += st0.gfree[g] - st1.gfree[g];
+  g = st.addr0 / st0.groupsize;
+  if(drop != N || (g < NBCGROUP && st0.gfree[g] == st1.gfree[g])){
+    printf("%s: %d blocks taken for %d, none in group %d\n", s, drop, N, g);
+    exit(1);
+  }
+  close(fd);
+
+  if(unlink("bgfile") < 0){
+    printf("%s: unlink failed\n", s);
+    exit(1);
+  }
+  sync();
+  bcstat(&st2);
+  for(g = 0; g < st0.ngroup && g < NBCGROUP; g++){
+    if(st2.gfree[g] != st0.gfree[g]){
+      printf("%s: group %d: %d free before, %d after unlink\n",
+             s, g, (int)st0.gfree[g], (int)st2.gfree[g]);
+      exit(1);
+    }
+  }
+}
+
+//
+// use sbrk() to count how many free physical memory pages there are.
+// touches the pages to force allocation.
+// because out of memory with lazy allocation results in the process
+// taking a fault and being killed, fork and report back.
+//
+int
+countfree()
+{
+  int fds[2];
+
+  // dirty file pages can't be given back until written.
+  sync();
+
+  if(pipe(fds) < 0){
+    printf("pipe() failed in countfree()\n");
+    exit(1);
+  }
+  
+  int pid = fork();
+
+  if(pid < 0){
+    printf("fork failed in countfree()\n");
+    exit(1);
+  }
+
+  if(pid == 0){
+    close(fds[0]);
+    
+    while(1){
+      uint64 a = (uint64) sbrk(4096);
+      if(a == 0xffffffffffffffff){
+        break;
+      }
+
+      // modify the memory to make sure it's really allocated.
+      *(char *)(a + 4096 - 1) = 1;
+
+      // report back one more page.
+      if(write(fds[1], "x", 1) != 1){
+        printf("write() failed in countfree()\n");
+        exit(1);
+      }
+    }
+
+    exit(0);
+  }
+
+  close(fds[1]);
+
+  int n = 0;
+  while(1){
+    char c;
+    int cc = read(fds[0], &c, 1);
+    if(cc < 0){
+      printf("read() failed in countfree()\n");
+      exit(1);
+    }
+    if(cc == 0)
+      break;
+    n += 1;
+  }
+
+  close(fds[0]);
+  wait((int*)0);
+  
+  return n;
+}
+
+// run each test in its own process. run returns 1 if child's exit()
+// indicates success.
+int
+run(void f(char *), char *s) {
+  int pid;
+  int xstatus;
+
+  printf("test %s: ", s);
+  if((pid = fork()) < 0) {
+    printf("runtest: fork error\n");
+    exit(1);
+  }
+  if(pid == 0) {
+    f(s);
+    exit(0);
+  } else {
+    wait(&xstatus);
+    if(xstatus != 0) 
+      printf("FAILED\n");
+    else
+      printf("OK\n");
+    return xstatus == 0;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int continuous = 0;
+  char *justone = 0;
+  struct stat st;
+
+  if(argc == 2 && strcmp(argv[1], "-c") == 0){
+    continuous = 1;
+  } else if(argc == 2 && strcmp(argv[1], "-C") == 0){
+    continuous = 2;
+  } else if(argc == 2 && argv[1][0] != '-'){
+    justone = argv[1];
+  } else if(argc > 1){
+    printf("Usage: usertests [-c] [testname]\n");
+    exit(1);
+  }
+  if(stat("/", &st) < 0){
+    printf("usertests: stat / failed\n");
     exit(1);
   }
+  fsbsize = st.blksize;
   
   struct test {
     void (*f)(char *);
@@ -2875,11 +4202,35 @@ main(int argc, char *argv[])
     {preempt, "preempt"},
     {exitwait, "exitwait"},
     {rmdot, "rmdot"},
-    {fourteen, "fourteen"},
+    {dirsiz, "dirsiz"},
     {bigfile, "bigfile"},
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {clocktest, "clocktest"},
+    {usyscalltest, "usyscall"},
+    {ringtest, "ringtest"},
+    {threadtest, "threadtest"},
+    {nicetest, "nicetest"},
+    {waitpidtest, "waitpidtest"},
+    {lockstattest, "lockstattest"},
+    {proftest, "proftest"},
+    {sysstattest, "sysstattest"},
+    {ktracetest, "ktracetest"},
+    {rusagetest, "rusagetest"},
+    {perfcounttest, "perfcounttest"},
+    {dcachetest, "dcachetest"},
+    {extentfile, "extentfile"},
+    {outofinodes, "outofinodes"},
+    {hashdir, "hashdir"},
+    {manyinodes, "manyinodes"},
+    {bcachegrow, "bcachegrow"},
+    {pagecache, "pagecache"},
+    {writeback, "writeback"},
+    {badpid, "badpid"},
+    {threadself, "threadself"},
+    {threadexec, "threadexec"},
+    {bgroups, "bgroups"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
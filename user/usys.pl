@@ -36,3 +36,21 @@ entry("getpid");
 entry("sbrk");
 entry("sleep");
 entry("uptime");
+entry("clock_gettime");
+entry("ringsetup");
+entry("ringenter");
+entry("clone");
+entry("futex");
+entry("setpriority");
+entry("waitpid");
+entry("lockstat");
+entry("prof");
+entry("sysstat");
+entry("trace");
+entry("ktrace");
+entry("ktread");
+entry("getrusage");
+entry("procinfo");
+entry("cpuinfo");
+entry("bcstat");
+entry("sync");